@@ -0,0 +1,58 @@
+#include "atomic_file.h"
+
+#include <unistd.h>
+
+#include <vector>
+
+AtomicFileWriter::AtomicFileWriter() : file_(nullptr), header_size_(0) {}
+
+AtomicFileWriter::~AtomicFileWriter() { abandon(); }
+
+bool AtomicFileWriter::open(const std::string& path, size_t header_size) {
+  abandon();
+  path_ = path;
+  // Including our process ID keeps two runs at once from writing the same
+  // temporary file.
+  temp_path_ = path + ".tmp" + std::to_string(getpid());
+  header_size_ = header_size;
+  file_ = std::fopen(temp_path_.c_str(), "wb");
+  if (file_ == nullptr) {
+    return false;
+  }
+  std::vector<char> placeholder(header_size, 0);
+  return write(placeholder.data(), placeholder.size());
+}
+
+bool AtomicFileWriter::write(const void* data, size_t size) {
+  if (file_ == nullptr) {
+    return false;
+  }
+  if (std::fwrite(data, 1, size, file_) != size) {
+    abandon();
+    return false;
+  }
+  return true;
+}
+
+bool AtomicFileWriter::commit(const void* header) {
+  if (file_ == nullptr) {
+    return false;
+  }
+  bool ok = std::fseek(file_, 0, SEEK_SET) == 0 &&
+            std::fwrite(header, 1, header_size_, file_) == header_size_;
+  ok = std::fclose(file_) == 0 && ok;
+  file_ = nullptr;
+  ok = ok && std::rename(temp_path_.c_str(), path_.c_str()) == 0;
+  if (!ok) {
+    std::remove(temp_path_.c_str());
+  }
+  return ok;
+}
+
+void AtomicFileWriter::abandon() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+    file_ = nullptr;
+    std::remove(temp_path_.c_str());
+  }
+}
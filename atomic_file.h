@@ -0,0 +1,51 @@
+#ifndef ATOMIC_FILE_H
+#define ATOMIC_FILE_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+// Writes a file so that it only appears under its name once it's complete,
+// for the files we write: --cache sidecars (cache_file.h) and --convert output
+// (binary_file.h).
+//
+// Everything goes to a temporary file next to the real one, named
+// <path>.tmp<pid>, and commit() renames it into place. rename() replaces any
+// old file in a single step, so readers see either the old file or the whole
+// new one: the file at path is never half-written. If commit() is never
+// called (the data source failed, say) or anything fails along the way, the
+// destructor deletes the temporary file. A process that's killed, or stopped
+// by Ctrl-C, doesn't get to run it, though, and leaves the temporary file
+// behind.
+//
+// Both formats start with a header holding the number of values, which isn't
+// known until the end. So open() reserves space for the header, and commit()
+// writes the real one over it.
+class AtomicFileWriter {
+ public:
+  AtomicFileWriter();
+  ~AtomicFileWriter();
+  AtomicFileWriter(const AtomicFileWriter&) = delete;
+  AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+  // Each returns false on an I/O error, after which the writer has deleted
+  // the temporary file and gives up; later calls fail too.
+  //
+  // open() creates the temporary file for path, starting with header_size
+  // bytes of placeholder.
+  bool open(const std::string& path, size_t header_size);
+  bool write(const void* data, size_t size);
+  // header must be header_size bytes, as passed to open().
+  bool commit(const void* header);
+
+ private:
+  std::FILE* file_;
+  std::string path_;
+  std::string temp_path_;
+  size_t header_size_;
+
+  // Closes and deletes the temporary file, if there is one.
+  void abandon();
+};
+
+#endif  // ATOMIC_FILE_H
@@ -0,0 +1,112 @@
+#include "binary_file.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <iterator>
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'T', 'A', 'T', 'S', 'B', 'I', 'N'};
+constexpr uint32_t kVersion = 1;
+
+// The header, laid out exactly as described in binary_file.h.
+struct BinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t type;
+  uint64_t count;
+  uint64_t reserved;
+};
+static_assert(sizeof(BinaryHeader) == 32, "binary header layout changed");
+
+constexpr bool kLittleEndian = std::endian::native == std::endian::little;
+
+size_t value_size(BinaryType type) {
+  return type == BinaryType::kFloat64 ? sizeof(double) : sizeof(float);
+}
+
+BinaryHeader make_header(BinaryType type, uint64_t count) {
+  BinaryHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.type = static_cast<uint32_t>(type);
+  header.count = count;
+  header.reserved = 0;
+  return header;
+}
+
+}  // namespace
+
+bool parse_binary(const MappedFile& file, BinaryData* data) {
+  if (!kLittleEndian || file.size() < sizeof(BinaryHeader)) {
+    return false;
+  }
+  BinaryHeader header;
+  std::memcpy(&header, file.begin(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion) {
+    return false;
+  }
+  BinaryType type = static_cast<BinaryType>(header.type);
+  if (type != BinaryType::kFloat64 && type != BinaryType::kFloat32) {
+    return false;
+  }
+  // Check the count against the file size without overflowing, in case the
+  // header is garbage.
+  size_t payload = file.size() - sizeof(header);
+  if (header.count != payload / value_size(type) ||
+      payload % value_size(type) != 0) {
+    return false;
+  }
+  const char* values = file.begin() + sizeof(header);
+  data->type = type;
+  if (type == BinaryType::kFloat64) {
+    data->doubles = std::span<const double>(
+        reinterpret_cast<const double*>(values), header.count);
+    data->floats = {};
+  } else {
+    data->floats = std::span<const float>(
+        reinterpret_cast<const float*>(values), header.count);
+    data->doubles = {};
+  }
+  return true;
+}
+
+BinaryWriter::BinaryWriter() : type_(BinaryType::kFloat64), count_(0) {}
+
+bool BinaryWriter::open(const std::string& path, BinaryType type) {
+  if (!kLittleEndian) {
+    return false;
+  }
+  type_ = type;
+  count_ = 0;
+  return file_.open(path, sizeof(BinaryHeader));
+}
+
+bool BinaryWriter::append(std::span<const double> values) {
+  if (type_ == BinaryType::kFloat64) {
+    if (!file_.write(values.data(), values.size_bytes())) {
+      return false;
+    }
+  } else {
+    // Convert a block at a time, so we don't need a second copy of values.
+    float block[1024];
+    for (size_t i = 0; i < values.size(); i += std::size(block)) {
+      size_t n = std::min(std::size(block), values.size() - i);
+      for (size_t j = 0; j < n; j++) {
+        block[j] = static_cast<float>(values[i + j]);
+      }
+      if (!file_.write(block, n * sizeof(float))) {
+        return false;
+      }
+    }
+  }
+  count_ += values.size();
+  return true;
+}
+
+bool BinaryWriter::commit() {
+  BinaryHeader header = make_header(type_, count_);
+  return file_.commit(&header);
+}
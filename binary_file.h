@@ -0,0 +1,77 @@
+#ifndef BINARY_FILE_H
+#define BINARY_FILE_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "atomic_file.h"
+#include "mapped_file.h"
+
+// The native binary input format (--bin), and the writer behind --convert.
+//
+// Text has to be parsed, which costs far more than reading the bytes. A binary
+// file instead holds the numbers exactly as they are laid out in memory, so
+// "reading" one is just mapping it: 8 GB of doubles costs whatever it takes
+// the OS to page them in.
+//
+// A binary file is a 32-byte header followed by the values:
+//
+//     offset  size  contents
+//          0     8  magic "STATSBIN"
+//          8     4  format version, 1
+//         12     4  value type: 1 for float64, 2 for float32
+//         16     8  number of values, N
+//         24     8  reserved, 0
+//         32   ...  N values, 8 or 4 bytes each
+//
+// Every integer and value is little-endian, which is the native byte order of
+// x86 and (almost all) ARM machines. Since we use the mapped values in place,
+// we don't support big-endian machines at all; there, parse_binary() and
+// BinaryWriter::open() simply fail. The 32-byte header keeps the values
+// aligned, since the mapping itself is page-aligned.
+
+enum class BinaryType : uint32_t {
+  kFloat64 = 1,
+  kFloat32 = 2,
+};
+
+// The values in a mapped binary file. Exactly one of the spans is used,
+// depending on type.
+struct BinaryData {
+  BinaryType type = BinaryType::kFloat64;
+  std::span<const double> doubles;
+  std::span<const float> floats;
+
+  size_t size() const {
+    return type == BinaryType::kFloat64 ? doubles.size() : floats.size();
+  }
+};
+
+// Checks that file holds a valid binary file, and points *data at its values.
+// The spans point into file's mapping, so file must outlive them.
+bool parse_binary(const MappedFile& file, BinaryData* data);
+
+// Writes a binary file. Like CacheWriter (see cache_file.h), it writes
+// through an AtomicFileWriter, so a failed conversion never leaves behind a
+// file that looks complete.
+class BinaryWriter {
+ public:
+  BinaryWriter();
+
+  // Each returns false on an I/O error, after which the writer gives up.
+  // append() converts to float32 if that's the type passed to open().
+  bool open(const std::string& path, BinaryType type);
+  bool append(std::span<const double> values);
+  bool commit();
+
+  // Number of values appended so far.
+  uint64_t count() const { return count_; }
+
+ private:
+  AtomicFileWriter file_;
+  BinaryType type_;
+  uint64_t count_;
+};
+
+#endif  // BINARY_FILE_H
@@ -0,0 +1,235 @@
+// Checks the --bin format of binary_file.h: that converting an input and
+// reading the result back gives exactly the same values, and that files that
+// aren't valid binary files are rejected. Run it with `make check`.
+//
+// The round trip goes the way `stats --file=... --convert=...` followed by
+// `stats --bin=...` does: a FileDataSource read in batches into a
+// BinaryWriter, then parse_binary() and a BinaryDataSource.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "binary_file.h"
+#include "data_source.h"
+#include "mapped_file.h"
+
+namespace {
+
+const char* const kTextPath = "binary_file_test.txt.tmp";
+const char* const kBinaryPath = "binary_file_test.bin.tmp";
+
+int failures = 0;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+void write_file(const std::string& path, const std::string& bytes) {
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  std::fwrite(bytes.data(), 1, bytes.size(), file);
+  std::fclose(file);
+}
+
+std::string read_file(const std::string& path) {
+  MappedFile file;
+  if (!file.open(path)) {
+    return "";
+  }
+  return std::string(file.begin(), file.end());
+}
+
+bool exists(const char* path) {
+  struct stat st;
+  return stat(path, &st) == 0;
+}
+
+bool same_bits(std::span<const double> a, std::span<const double> b) {
+  return a.size() == b.size() &&
+         std::memcmp(a.data(), b.data(), a.size_bytes()) == 0;
+}
+
+// Does what --convert does: copies every value of source to a binary file,
+// in batches.
+bool convert(DataSource& source, BinaryType type) {
+  BinaryWriter writer;
+  if (!writer.open(kBinaryPath, type)) {
+    return false;
+  }
+  std::vector<double> buffer(4096);
+  while (size_t n = source.read_some(buffer)) {
+    if (!writer.append(std::span<const double>(buffer.data(), n))) {
+      return false;
+    }
+  }
+  return writer.commit();
+}
+
+// Whether the file at kBinaryPath is a valid binary file.
+bool valid() {
+  MappedFile file;
+  BinaryData data;
+  return file.open(kBinaryPath) && parse_binary(file, &data);
+}
+
+// Reads the file at kBinaryPath as --bin does, with read(), or with
+// read_some() if batch_size isn't 0.
+std::vector<double> read_binary(size_t batch_size) {
+  MappedFile file;
+  BinaryData data;
+  if (!file.open(kBinaryPath) || !parse_binary(file, &data)) {
+    fail("a converted file isn't a valid binary file");
+    return {};
+  }
+  BinaryDataSource source(std::move(file), data);
+  if (batch_size == 0) {
+    return source.read().take();
+  }
+  std::vector<double> values;
+  std::vector<double> buffer(batch_size);
+  while (size_t n = source.read_some(buffer)) {
+    values.insert(values.end(), buffer.begin(), buffer.begin() + n);
+  }
+  return values;
+}
+
+void check_round_trip(const std::string& what, const std::string& text) {
+  write_file(kTextPath, text);
+  MappedFile file;
+  file.open(kTextPath);
+  std::vector<double> expected = FileDataSource(std::move(file)).read().take();
+
+  for (BinaryType type : {BinaryType::kFloat64, BinaryType::kFloat32}) {
+    bool float32 = type == BinaryType::kFloat32;
+    std::string name = what + (float32 ? " as float32" : " as float64");
+    file.open(kTextPath);
+    FileDataSource source(std::move(file));
+    if (!convert(source, type)) {
+      fail("can't convert " + name);
+      continue;
+    }
+    // float32 keeps what a float can hold, exactly that.
+    std::vector<double> wanted = expected;
+    if (float32) {
+      for (double& x : wanted) {
+        x = static_cast<float>(x);
+      }
+    }
+    for (size_t batch_size : {0, 1, 7, 4096}) {
+      if (!same_bits(read_binary(batch_size), wanted)) {
+        fail(name + " doesn't round-trip with batches of " +
+             std::to_string(batch_size));
+      }
+    }
+  }
+}
+
+// Writes bytes to kBinaryPath, with value in place of the bytes at offset.
+template <typename T>
+void patch(const std::string& bytes, size_t offset, T value) {
+  std::string patched = bytes;
+  std::memcpy(patched.data() + offset, &value, sizeof(value));
+  write_file(kBinaryPath, patched);
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  std::string text = "0\n-0\n1e-320\ninf\n-inf\nnan\n1e300\n";
+  char buf[32];
+  for (size_t i = 0; i < 100000; i++) {
+    text.append(buf, std::snprintf(buf, sizeof(buf), "%.17g\n", normal(rng)));
+  }
+  check_round_trip("a data.txt file", text);
+  check_round_trip("an empty file", "");
+
+  // Files that aren't valid: too short for a header, or for their values,
+  // or with a header that's wrong in any field.
+  write_file(kTextPath, "1\n2\n3\n4\n5\n");
+  MappedFile file;
+  file.open(kTextPath);
+  FileDataSource source(std::move(file));
+  convert(source, BinaryType::kFloat64);
+  std::string bytes = read_file(kBinaryPath);
+  if (bytes.size() != 32 + 5 * sizeof(double) || !valid()) {
+    fail("a converted file is the wrong size");
+  }
+  for (size_t size : {size_t(0), size_t(31), bytes.size() - 8,
+                      bytes.size() - 1}) {
+    write_file(kBinaryPath, bytes.substr(0, size));
+    if (valid()) {
+      fail("a binary file cut to " + std::to_string(size) +
+           " bytes is accepted");
+    }
+  }
+  write_file(kBinaryPath, bytes + "abc");
+  if (valid()) {
+    fail("a binary file that isn't a whole number of values is accepted");
+  }
+  write_file(kBinaryPath, bytes + std::string(8, '\0'));
+  if (valid()) {
+    fail("a binary file with an extra value is accepted");
+  }
+  write_file(kBinaryPath, "STATSBIX" + bytes.substr(8));
+  if (valid()) {
+    fail("a binary file with the wrong magic number is accepted");
+  }
+  patch(bytes, 8, uint32_t(2));
+  if (valid()) {
+    fail("a binary file with an unknown version is accepted");
+  }
+  patch(bytes, 12, uint32_t(3));
+  if (valid()) {
+    fail("a binary file with an unknown value type is accepted");
+  }
+  // As float32, the same bytes hold 10 values, not 5.
+  patch(bytes, 12, uint32_t(BinaryType::kFloat32));
+  if (valid()) {
+    fail("a binary file with the wrong value type is accepted");
+  }
+  // 2^61 + 5 values of 8 bytes would wrap around to 40 bytes.
+  patch(bytes, 16, (uint64_t(1) << 61) + 5);
+  if (valid()) {
+    fail("a binary file with an overflowing count is accepted");
+  }
+  write_file(kBinaryPath, bytes);
+  if (!valid()) {
+    fail("a repaired binary file isn't accepted");
+  }
+
+  // The file only appears when the writer commits.
+  std::remove(kBinaryPath);
+  {
+    BinaryWriter writer;
+    writer.open(kBinaryPath, BinaryType::kFloat64);
+    std::vector<double> values(1000, 1.0);
+    writer.append(values);
+    if (exists(kBinaryPath)) {
+      fail("a binary file appears before it's committed");
+    }
+  }
+  if (exists(kBinaryPath)) {
+    fail("a binary file appears without being committed");
+  }
+
+  std::remove(kTextPath);
+  std::remove(kBinaryPath);
+
+  if (failures > 0) {
+    std::cerr << "binary_file: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "binary_file: all checks passed\n";
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "bulk_normal.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// This file is compiled with extra optimization flags; see the Makefile. In
+// particular -ffast-math lets GCC replace the calls to log(), cos() and sin()
+// in refill() with SIMD versions from the C library (glibc's libmvec), which
+// compute 2 or 4 of them at once.
+
+namespace {
+
+// SplitMix64, the recommended way to expand one seed into xoshiro's state.
+uint64_t splitmix64(uint64_t* x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+constexpr double kTwoPi = 6.283185307179586;
+
+}  // namespace
+
+BulkNormalGenerator::BulkNormalGenerator(uint64_t seed, double mean,
+                                         double stdev)
+    : mean_(mean), stdev_(stdev), pos_(kBlockSize) {
+  uint64_t x = seed;
+  for (size_t lane = 0; lane < kLanes; lane++) {
+    for (size_t i = 0; i < 4; i++) {
+      state_[i][lane] = splitmix64(&x);
+    }
+  }
+}
+
+void BulkNormalGenerator::fill(std::span<double> out) {
+  while (!out.empty()) {
+    if (pos_ == kBlockSize) {
+      refill();
+    }
+    size_t n = std::min(out.size(), kBlockSize - pos_);
+    std::copy_n(block_ + pos_, n, out.begin());
+    pos_ += n;
+    out = out.subspan(n);
+  }
+}
+
+void BulkNormalGenerator::refill() {
+  // Step 1: uniform numbers in (0, 1]. The inner loop advances every lane by
+  // one step of xoshiro256+; it has no branches and no dependencies between
+  // lanes, so it vectorizes.
+  double uniform[kBlockSize];
+  // Work on local copies of the state. The compiler can keep these in
+  // registers, where it can't be sure that stores to uniform don't change
+  // state_.
+  uint64_t s0[kLanes], s1[kLanes], s2[kLanes], s3[kLanes];
+  std::copy_n(state_[0], kLanes, s0);
+  std::copy_n(state_[1], kLanes, s1);
+  std::copy_n(state_[2], kLanes, s2);
+  std::copy_n(state_[3], kLanes, s3);
+  for (size_t i = 0; i < kBlockSize; i += kLanes) {
+    for (size_t lane = 0; lane < kLanes; lane++) {
+      uint64_t result = s0[lane] + s3[lane];
+      uint64_t t = s1[lane] << 17;
+      s2[lane] ^= s0[lane];
+      s3[lane] ^= s1[lane];
+      s1[lane] ^= s2[lane];
+      s0[lane] ^= s3[lane];
+      s2[lane] ^= t;
+      s3[lane] = rotl(s3[lane], 45);
+      // Put the top 52 bits in the fraction of a double with exponent 0,
+      // giving a value in [1, 2). (Converting the integer to double directly
+      // would be simpler, but SSE2 and AVX2 have no instruction for that.)
+      // Subtracting from 2 gives (0, 1], so log() below never sees 0.
+      uniform[i + lane] =
+          2.0 - std::bit_cast<double>((result >> 12) | 0x3ff0000000000000);
+    }
+  }
+  std::copy_n(s0, kLanes, state_[0]);
+  std::copy_n(s1, kLanes, state_[1]);
+  std::copy_n(s2, kLanes, state_[2]);
+  std::copy_n(s3, kLanes, state_[3]);
+
+  // Step 2: Box-Muller. The first half of uniform supplies u, the second half
+  // v. The cos() and sin() halves are separate loops on purpose: GCC would
+  // otherwise merge them into a single sincos() call, which has no SIMD
+  // version.
+  constexpr size_t kHalf = kBlockSize / 2;
+  double radius[kHalf];
+  for (size_t i = 0; i < kHalf; i++) {
+    radius[i] = stdev_ * std::sqrt(-2.0 * std::log(uniform[i]));
+  }
+  for (size_t i = 0; i < kHalf; i++) {
+    block_[i] = mean_ + radius[i] * std::cos(kTwoPi * uniform[kHalf + i]);
+  }
+  for (size_t i = 0; i < kHalf; i++) {
+    block_[kHalf + i] =
+        mean_ + radius[i] * std::sin(kTwoPi * uniform[kHalf + i]);
+  }
+  pos_ = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BULK_NORMAL_H
+#define BULK_NORMAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Generates normally distributed random numbers in bulk, for
+// RandomNormalDataSource's --generator=bulk mode.
+//
+// std::normal_distribution produces one value per call, and the usual
+// implementation (Marsaglia's polar method) loops until a random point lands
+// inside a circle, so the CPU can't predict its branches or do several values
+// at once. It's also fed by std::mt19937_64, which is a fairly slow generator.
+//
+// We instead produce a block of values at a time, with loops the compiler can
+// turn into SIMD code:
+//
+// 1.  Uniform random numbers come from xoshiro256+, a small, fast generator.
+//     We run kLanes independent copies side by side ("lanes"), so that one
+//     SIMD instruction advances all of them at once. See:
+//
+//         https://prng.di.unimi.it/
+//
+// 2.  The Box-Muller transform turns each pair of uniform numbers (u, v) into
+//     two normal numbers, sqrt(-2 ln u) * cos(2 pi v) and
+//     sqrt(-2 ln u) * sin(2 pi v). There's no rejection loop, so the same
+//     operations run on every element of the block.
+//
+// The output is deterministic for a given seed, but it's a different sequence
+// from std::normal_distribution with the same seed.
+class BulkNormalGenerator {
+ public:
+  BulkNormalGenerator(uint64_t seed, double mean, double stdev);
+
+  // Fills all of out with random values.
+  void fill(std::span<double> out);
+
+ private:
+  // Number of independent xoshiro256+ generators.
+  static constexpr size_t kLanes = 8;
+  // Values generated per refill(). Must be a multiple of 2 * kLanes.
+  static constexpr size_t kBlockSize = 512;
+
+  // Generates the next block into block_.
+  void refill();
+
+  // The xoshiro256+ state: state_[i][lane] is word i of that lane's state.
+  // Storing the lanes next to each other (rather than each lane's four words
+  // together) is what lets the compiler load a word for every lane at once.
+  uint64_t state_[4][kLanes];
+  double mean_;
+  double stdev_;
+  double block_[kBlockSize];
+  // Next unused value in block_.
+  size_t pos_;
+};
+
+#endif  // BULK_NORMAL_H
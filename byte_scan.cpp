@@ -0,0 +1,123 @@
+#include "byte_scan.h"
+
+#include "byte_scan_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define BYTE_SCAN_X86 1
+#endif
+
+const char* skip_fields_scalar(const char* p, const char* end, char delim,
+                               size_t n) {
+  if (n == 0) {
+    return p;
+  }
+  bool quoted = false;
+  for (; p != end; ++p) {
+    char c = *p;
+    if (c == '"') {
+      quoted = !quoted;
+    } else if (!quoted) {
+      if (c == '\n') {
+        return nullptr;
+      }
+      if (c == delim && --n == 0) {
+        return p + 1;
+      }
+    }
+  }
+  return nullptr;
+}
+
+const char* find_record_end_scalar(const char* p, const char* end,
+                                   bool quoted) {
+  for (; p != end; ++p) {
+    if (*p == '"') {
+      quoted = !quoted;
+    } else if (*p == '\n' && !quoted) {
+      return p;
+    }
+  }
+  return end;
+}
+
+#ifdef BYTE_SCAN_X86
+namespace {
+
+// SSE2 is part of every x86-64 CPU, so this needs no special compiler flags.
+// Each _mm_cmpeq_epi8 compares 16 bytes at once; _mm_movemask_epi8 packs the
+// results into the low 16 bits of an int.
+struct Sse2Loader {
+  static void load(const char* p, char delim, uint64_t* delims,
+                   uint64_t* newlines, uint64_t* quotes) {
+    const __m128i d = _mm_set1_epi8(delim);
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i q = _mm_set1_epi8('"');
+    uint64_t dm = 0;
+    uint64_t nm = 0;
+    uint64_t qm = 0;
+    for (int i = 0; i < 4; i++) {
+      __m128i bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+      dm |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, d))))
+            << (16 * i);
+      nm |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, nl))))
+            << (16 * i);
+      qm |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, q))))
+            << (16 * i);
+    }
+    *delims = dm;
+    *newlines = nm;
+    *quotes = qm;
+  }
+};
+
+}  // namespace
+
+const char* skip_fields_sse2(const char* p, const char* end, char delim,
+                             size_t n) {
+  return skip_fields_blocks<Sse2Loader>(p, end, delim, n);
+}
+
+const char* find_record_end_sse2(const char* p, const char* end, bool quoted) {
+  return find_record_end_blocks<Sse2Loader>(p, end, quoted);
+}
+#endif  // BYTE_SCAN_X86
+
+namespace {
+
+using SkipFieldsFn = const char* (*)(const char*, const char*, char, size_t);
+using FindRecordEndFn = const char* (*)(const char*, const char*, bool);
+
+// The fastest implementations this CPU supports. choose_implementations()
+// fills them in once, when the program starts.
+struct Implementations {
+  SkipFieldsFn skip_fields;
+  FindRecordEndFn find_record_end;
+};
+
+Implementations choose_implementations() {
+#ifdef BYTE_SCAN_X86
+  // We're called during static initialization, possibly before the compiler's
+  // own CPU detection has run, so run it explicitly.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {skip_fields_avx2, find_record_end_avx2};
+  }
+  return {skip_fields_sse2, find_record_end_sse2};
+#else
+  return {skip_fields_scalar, find_record_end_scalar};
+#endif
+}
+
+const Implementations impl = choose_implementations();
+
+}  // namespace
+
+const char* skip_fields(const char* p, const char* end, char delim, size_t n) {
+  return impl.skip_fields(p, end, delim, n);
+}
+
+const char* find_record_end(const char* p, const char* end, bool quoted) {
+  return impl.find_record_end(p, end, quoted);
+}
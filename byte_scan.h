@@ -0,0 +1,36 @@
+#ifndef BYTE_SCAN_H
+#define BYTE_SCAN_H
+
+#include <cstddef>
+
+// Fast scanning over delimited text, used by CsvDataSource.
+//
+// Most of the bytes in a CSV file belong to columns we don't care about. Rather
+// than tokenizing each of those fields, we only need to find the delimiters
+// that separate them. SIMD ("single instruction, multiple data") instructions
+// let us compare 16 (SSE2) or 32 (AVX2) bytes against the delimiter at once and
+// get back a bitmask of the matches, so we can skip whole blocks of a line in a
+// handful of instructions.
+//
+// Fields may be quoted, as in RFC 4180: inside "double quotes", delimiters and
+// newlines are part of the field, and "" is an escaped quote. Quotes are rare
+// in numeric data, so when a block contains one we simply finish the current
+// call byte by byte, keeping track of whether we're inside quotes. (Treating
+// every quote as a toggle handles "" correctly, since it toggles twice.)
+//
+// The best implementation is chosen once at startup, based on what the CPU
+// supports. There's always a plain scalar fallback for other CPUs.
+
+// Skips n delimited fields of the current record, starting at p (which should
+// be the start of a field). Returns a pointer just past the n-th delimiter,
+// i.e. the start of field n. Returns nullptr if the end of the record (an
+// unquoted newline) or of the input comes first, meaning the record has too
+// few fields.
+const char* skip_fields(const char* p, const char* end, char delim, size_t n);
+
+// Returns a pointer to the newline that ends the current record, or end if
+// there is none. quoted says whether p is inside a quoted field.
+const char* find_record_end(const char* p, const char* end,
+                            bool quoted = false);
+
+#endif  // BYTE_SCAN_H
@@ -0,0 +1,44 @@
+// AVX2 versions of the byte scanning functions. This file is compiled with
+// -mavx2 (see the Makefile), which lets the compiler use AVX2 instructions
+// anywhere in it. That's why it's separate from byte_scan.cpp: code in this
+// file must only run after checking that the CPU supports AVX2, which
+// byte_scan.cpp does.
+
+#include "byte_scan_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+namespace {
+
+// Like Sse2Loader in byte_scan.cpp, but 32 bytes per comparison.
+struct Avx2Loader {
+  static void load(const char* p, char delim, uint64_t* delims,
+                   uint64_t* newlines, uint64_t* quotes) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    *delims = mask(lo, hi, delim);
+    *newlines = mask(lo, hi, '\n');
+    *quotes = mask(lo, hi, '"');
+  }
+
+  // Bit i is set if byte i of the 64 bytes in lo, hi equals c.
+  static uint64_t mask(__m256i lo, __m256i hi, char c) {
+    const __m256i v = _mm256_set1_epi8(c);
+    return uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)))) |
+           uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v))))
+               << 32;
+  }
+};
+
+}  // namespace
+
+const char* skip_fields_avx2(const char* p, const char* end, char delim,
+                             size_t n) {
+  return skip_fields_blocks<Avx2Loader>(p, end, delim, n);
+}
+
+const char* find_record_end_avx2(const char* p, const char* end, bool quoted) {
+  return find_record_end_blocks<Avx2Loader>(p, end, quoted);
+}
+#endif
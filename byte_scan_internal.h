@@ -0,0 +1,97 @@
+#ifndef BYTE_SCAN_INTERNAL_H
+#define BYTE_SCAN_INTERNAL_H
+
+// Implementation details shared by byte_scan.cpp and byte_scan_avx2.cpp. Not
+// part of the public interface; use byte_scan.h instead.
+
+#include <cstddef>
+#include <cstdint>
+
+// The portable byte-at-a-time versions. Also used to finish off the last few
+// bytes of input that don't fill a whole SIMD block, and any block that
+// contains a quote.
+const char* skip_fields_scalar(const char* p, const char* end, char delim,
+                               size_t n);
+const char* find_record_end_scalar(const char* p, const char* end,
+                                   bool quoted);
+
+// Only available when the CPU and compiler support it; see byte_scan.cpp.
+const char* skip_fields_sse2(const char* p, const char* end, char delim,
+                             size_t n);
+const char* skip_fields_avx2(const char* p, const char* end, char delim,
+                             size_t n);
+const char* find_record_end_sse2(const char* p, const char* end, bool quoted);
+const char* find_record_end_avx2(const char* p, const char* end, bool quoted);
+
+// The SIMD-independent parts of skip_fields() and find_record_end(). Loader is
+// a type with a static function
+//
+//     static void load(const char* p, char delim, uint64_t* delims,
+//                      uint64_t* newlines, uint64_t* quotes);
+//
+// which sets bit i of *delims if p[i] == delim, bit i of *newlines if
+// p[i] == '\n' and bit i of *quotes if p[i] == '"', for a 64-byte block. Each
+// .cpp file provides a Loader written with its own instruction set, declared
+// in an unnamed namespace so that the instantiations in different files never
+// clash.
+template <typename Loader>
+const char* skip_fields_blocks(const char* p, const char* end, char delim,
+                               size_t n) {
+  if (n == 0) {
+    return p;
+  }
+  while (end - p >= 64) {
+    uint64_t delims;
+    uint64_t newlines;
+    uint64_t quotes;
+    Loader::load(p, delim, &delims, &newlines, &quotes);
+    if (quotes != 0) {
+      break;
+    }
+    if (newlines != 0) {
+      // Only delimiters before the first newline belong to this line.
+      // (newlines & -newlines) isolates the lowest set bit; subtracting one
+      // gives a mask of all the bits below it.
+      delims &= (newlines & -newlines) - 1;
+    }
+    size_t found = __builtin_popcountll(delims);
+    if (found >= n) {
+      // The delimiter we want is in this block. Clear the lowest set bit n-1
+      // times, and the lowest remaining bit is the n-th delimiter.
+      for (size_t i = 1; i < n; i++) {
+        delims &= delims - 1;
+      }
+      return p + __builtin_ctzll(delims) + 1;
+    }
+    if (newlines != 0) {
+      return nullptr;
+    }
+    n -= found;
+    p += 64;
+  }
+  return skip_fields_scalar(p, end, delim, n);
+}
+
+template <typename Loader>
+const char* find_record_end_blocks(const char* p, const char* end,
+                                   bool quoted) {
+  if (quoted) {
+    return find_record_end_scalar(p, end, quoted);
+  }
+  while (end - p >= 64) {
+    uint64_t delims;
+    uint64_t newlines;
+    uint64_t quotes;
+    Loader::load(p, ',', &delims, &newlines, &quotes);
+    if (quotes != 0) {
+      break;
+    }
+    if (newlines != 0) {
+      return p + __builtin_ctzll(newlines);
+    }
+    p += 64;
+  }
+  return find_record_end_scalar(p, end, false);
+}
+
+#endif  // BYTE_SCAN_INTERNAL_H
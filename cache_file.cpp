@@ -0,0 +1,102 @@
+#include "cache_file.h"
+
+#include <sys/stat.h>
+
+#include <cstring>
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'T', 'A', 'T', 'S', 'C', 'A', '1'};
+
+// The header, laid out exactly as described in cache_file.h. Every field is 8
+// bytes, so there's no padding.
+struct CacheHeader {
+  char magic[8];
+  uint64_t source_size;
+  int64_t source_mtime_ns;
+  uint64_t column;
+  uint64_t count;
+  uint64_t reserved;
+};
+static_assert(sizeof(CacheHeader) == 48, "cache header layout changed");
+
+CacheHeader make_header(const CacheKey& key, uint64_t count) {
+  CacheHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.source_size = key.size;
+  header.source_mtime_ns = key.mtime_ns;
+  header.column = key.column;
+  header.count = count;
+  header.reserved = 0;
+  return header;
+}
+
+}  // namespace
+
+bool get_cache_key(const std::string& source, uint64_t column, CacheKey* key) {
+  struct stat st;
+  if (stat(source.c_str(), &st) != 0) {
+    return false;
+  }
+  key->size = st.st_size;
+  key->mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  key->column = column;
+  return true;
+}
+
+std::string cache_path(const std::string& source, uint64_t column) {
+  if (column == kNoColumn) {
+    return source + ".stats-cache";
+  }
+  return source + ".col" + std::to_string(column) + ".stats-cache";
+}
+
+bool open_cache(const std::string& path, const CacheKey& key, MappedFile* file,
+                std::span<const double>* values) {
+  MappedFile mapped;
+  if (!mapped.open(path) || mapped.size() < sizeof(CacheHeader)) {
+    return false;
+  }
+  CacheHeader header;
+  std::memcpy(&header, mapped.begin(), sizeof(header));
+  // Check the count against the file size by dividing, as parse_binary()
+  // does: header.count * sizeof(double) could overflow for a corrupt count,
+  // and wrap around to match the size.
+  size_t payload = mapped.size() - sizeof(header);
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.source_size != key.size ||
+      header.source_mtime_ns != key.mtime_ns || header.column != key.column ||
+      header.count != payload / sizeof(double) ||
+      payload % sizeof(double) != 0) {
+    return false;
+  }
+  // mmap() returns page-aligned memory, and the header is 48 bytes, so the
+  // values are properly aligned for double.
+  *values = std::span<const double>(
+      reinterpret_cast<const double*>(mapped.begin() + sizeof(header)),
+      header.count);
+  // Moving a MappedFile doesn't move the mapping, so *values stays valid.
+  *file = std::move(mapped);
+  return true;
+}
+
+CacheWriter::CacheWriter() : count_(0) {}
+
+bool CacheWriter::open(const std::string& path, const CacheKey& key) {
+  key_ = key;
+  count_ = 0;
+  return file_.open(path, sizeof(CacheHeader));
+}
+
+bool CacheWriter::append(std::span<const double> values) {
+  if (!file_.write(values.data(), values.size_bytes())) {
+    return false;
+  }
+  count_ += values.size();
+  return true;
+}
+
+bool CacheWriter::commit() {
+  CacheHeader header = make_header(key_, count_);
+  return file_.commit(&header);
+}
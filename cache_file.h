@@ -0,0 +1,76 @@
+#ifndef CACHE_FILE_H
+#define CACHE_FILE_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "atomic_file.h"
+#include "mapped_file.h"
+
+// Binary cache "sidecar" files for parsed text inputs (the --cache option).
+//
+// Parsing text is the slowest part of reading data.txt or test.csv. With
+// --cache, the first run saves the parsed values next to the input, in a file
+// named like data.txt.stats-cache (or test.csv.col3.stats-cache for one CSV
+// column). Later runs memory-map the cache and skip parsing entirely.
+//
+// A cache file is a 48-byte header followed by the values as raw doubles, in
+// the machine's native byte order (the cache is only meant for the machine
+// that wrote it):
+//
+//     offset  size  contents
+//          0     8  magic "STATSCA1"
+//          8     8  size of the source file, in bytes
+//         16     8  modification time of the source file, in ns since 1970
+//         24     8  CSV column number, or kNoColumn for --file
+//         32     8  number of values
+//         40     8  reserved, 0
+//         48   8*N  the values
+//
+// The size, time and column form the CacheKey. If the source file changes,
+// its size or modification time will too, and the stale cache is ignored (and
+// overwritten).
+
+// Identifies the exact input a cache file was made from.
+struct CacheKey {
+  uint64_t size = 0;
+  int64_t mtime_ns = 0;
+  uint64_t column = 0;
+};
+
+// Column number used for inputs that have no columns (--file).
+constexpr uint64_t kNoColumn = UINT64_MAX;
+
+// Fills *key for the current state of the file at source. Returns false if the
+// file doesn't exist.
+bool get_cache_key(const std::string& source, uint64_t column, CacheKey* key);
+
+// The name of the cache file for source and column.
+std::string cache_path(const std::string& source, uint64_t column);
+
+// Opens the cache file at path and checks that it was made from key. On
+// success, returns true, stores the mapping in *file and points *values at the
+// cached values inside it.
+bool open_cache(const std::string& path, const CacheKey& key, MappedFile* file,
+                std::span<const double>* values);
+
+// Writes a cache file. The file only appears once commit() succeeds (see
+// AtomicFileWriter), so a run that's interrupted part way never leaves behind
+// a truncated cache that looks valid.
+class CacheWriter {
+ public:
+  CacheWriter();
+
+  // Each returns false on an I/O error, after which the writer gives up.
+  bool open(const std::string& path, const CacheKey& key);
+  bool append(std::span<const double> values);
+  bool commit();
+
+ private:
+  AtomicFileWriter file_;
+  CacheKey key_;
+  uint64_t count_;
+};
+
+#endif  // CACHE_FILE_H
@@ -0,0 +1,212 @@
+// Checks the --cache sidecar files of cache_file.h: that values come back
+// bit for bit, that a cache is ignored once it no longer matches its source,
+// and that a damaged cache is rejected rather than mapped. Run it with
+// `make check`.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "cache_file.h"
+#include "mapped_file.h"
+
+namespace {
+
+// A stand-in for data.txt or test.csv. Only its size and modification time
+// matter.
+const char* const kSourcePath = "cache_file_test.tmp";
+
+int failures = 0;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+void write_file(const std::string& path, const std::string& bytes) {
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  std::fwrite(bytes.data(), 1, bytes.size(), file);
+  std::fclose(file);
+}
+
+std::string read_file(const std::string& path) {
+  MappedFile file;
+  if (!file.open(path)) {
+    return "";
+  }
+  return std::string(file.begin(), file.end());
+}
+
+// Writes a cache of values for the current state of the source file, in
+// batches, as CacheWritingDataSource does.
+bool write_cache(uint64_t column, const std::vector<double>& values) {
+  CacheKey key;
+  CacheWriter writer;
+  if (!get_cache_key(kSourcePath, column, &key) ||
+      !writer.open(cache_path(kSourcePath, column), key)) {
+    return false;
+  }
+  std::span<const double> rest(values);
+  while (!rest.empty()) {
+    size_t n = std::min<size_t>(rest.size(), 1000);
+    if (!writer.append(rest.first(n))) {
+      return false;
+    }
+    rest = rest.subspan(n);
+  }
+  return writer.commit();
+}
+
+// Whether the cache for column opens for the current state of the source
+// file. If values isn't null, it must also hold exactly those values.
+bool cache_opens(uint64_t column,
+                 const std::vector<double>* values = nullptr) {
+  CacheKey key;
+  MappedFile file;
+  std::span<const double> cached;
+  if (!get_cache_key(kSourcePath, column, &key) ||
+      !open_cache(cache_path(kSourcePath, column), key, &file, &cached)) {
+    return false;
+  }
+  // Compare the bytes: NaN != NaN, and -0.0 == 0.0.
+  if (values != nullptr &&
+      (cached.size() != values->size() ||
+       std::memcmp(cached.data(), values->data(), cached.size_bytes()) != 0)) {
+    fail("the cache doesn't hold the values written to it");
+  }
+  return true;
+}
+
+// Sets the source file's modification time.
+void set_mtime(int64_t seconds, int64_t nanoseconds) {
+  timespec times[2] = {{0, UTIME_OMIT}, {seconds, nanoseconds}};
+  utimensat(AT_FDCWD, kSourcePath, times, 0);
+}
+
+// Puts a 64-bit number at offset in the cache file for column.
+void patch_cache(uint64_t column, size_t offset, uint64_t value) {
+  std::string bytes = read_file(cache_path(kSourcePath, column));
+  std::memcpy(bytes.data() + offset, &value, sizeof(value));
+  write_file(cache_path(kSourcePath, column), bytes);
+}
+
+}  // namespace
+
+int main() {
+  const uint64_t kColumn = 3;
+  std::vector<double> values = {0.0,
+                                -0.0,
+                                1.5,
+                                std::numeric_limits<double>::denorm_min(),
+                                std::numeric_limits<double>::infinity(),
+                                -std::numeric_limits<double>::infinity(),
+                                std::numeric_limits<double>::quiet_NaN()};
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (size_t i = 0; i < 100000; i++) {
+    values.push_back(normal(rng));
+  }
+
+  // Round trips, for --file and a CSV column, and for no values at all.
+  write_file(kSourcePath, "1\n2\n3\n");
+  set_mtime(1000000000, 123456789);
+  for (uint64_t column : {kNoColumn, kColumn}) {
+    if (!write_cache(column, values) || !cache_opens(column, &values)) {
+      fail("a cache doesn't round-trip for column " + std::to_string(column));
+    }
+  }
+  std::vector<double> none;
+  write_file(kSourcePath, "");
+  if (!write_cache(kColumn, none) || !cache_opens(kColumn, &none)) {
+    fail("an empty cache doesn't round-trip");
+  }
+
+  // A changed source: a different size, or only a different modification
+  // time (down to the nanosecond, as when a file is rewritten within the
+  // same second).
+  write_file(kSourcePath, "1\n2\n3\n");
+  set_mtime(1000000000, 123456789);
+  write_cache(kColumn, values);
+  write_file(kSourcePath, "1\n2\n3\n4\n");
+  set_mtime(1000000000, 123456789);
+  if (cache_opens(kColumn)) {
+    fail("a cache is used after its source changed size");
+  }
+  write_file(kSourcePath, "1\n2\n3\n");
+  set_mtime(1000000000, 123456790);
+  if (cache_opens(kColumn)) {
+    fail("a cache is used after its source's modification time changed");
+  }
+  set_mtime(1000000000, 123456789);
+  if (!cache_opens(kColumn, &values)) {
+    fail("a cache isn't used once its source is back as it was");
+  }
+
+  // Another column has another cache file, and a cache file that claims the
+  // wrong column is ignored.
+  std::remove(cache_path(kSourcePath, kColumn + 1).c_str());
+  if (cache_opens(kColumn + 1)) {
+    fail("a cache is used for a different column");
+  }
+  std::string bytes = read_file(cache_path(kSourcePath, kColumn));
+  write_file(cache_path(kSourcePath, kColumn + 1), bytes);
+  if (cache_opens(kColumn + 1)) {
+    fail("a cache file for another column is used");
+  }
+  std::remove(cache_path(kSourcePath, kColumn + 1).c_str());
+
+  // Damaged caches: truncated (mid-value, and mid-header), a bad magic
+  // number, and counts that don't match the file. The last count is 2^61
+  // more than the real one, so count * 8 wraps around to the right size.
+  std::string path = cache_path(kSourcePath, kColumn);
+  write_file(path, bytes.substr(0, bytes.size() - 3));
+  if (cache_opens(kColumn)) {
+    fail("a truncated cache is used");
+  }
+  write_file(path, bytes.substr(0, bytes.size() - 8));
+  if (cache_opens(kColumn)) {
+    fail("a cache missing its last value is used");
+  }
+  write_file(path, bytes.substr(0, 40));
+  if (cache_opens(kColumn)) {
+    fail("a cache with a truncated header is used");
+  }
+  write_file(path, "X" + bytes.substr(1));
+  if (cache_opens(kColumn)) {
+    fail("a cache with a bad magic number is used");
+  }
+  for (uint64_t count : {uint64_t(0), uint64_t(values.size() + 1),
+                         values.size() + (uint64_t(1) << 61)}) {
+    write_file(path, bytes);
+    patch_cache(kColumn, 32, count);
+    if (cache_opens(kColumn)) {
+      fail("a cache with a count of " + std::to_string(count) + " is used");
+    }
+  }
+  write_file(path, bytes);
+  if (!cache_opens(kColumn, &values)) {
+    fail("a cache isn't used after it's repaired");
+  }
+
+  std::remove(path.c_str());
+  std::remove(cache_path(kSourcePath, kNoColumn).c_str());
+  std::remove(kSourcePath);
+
+  if (failures > 0) {
+    std::cerr << "cache_file: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "cache_file: all checks passed\n";
+  return 0;
+}
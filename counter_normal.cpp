@@ -0,0 +1,106 @@
+#include "counter_normal.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// Like bulk_normal.cpp, this file is compiled with -O3 -ffast-math (see the
+// Makefile), so the Box-Muller loops use SIMD versions of log(), cos() and
+// sin().
+
+namespace {
+
+// The Philox4x32 constants from the paper.
+constexpr uint32_t kPhiloxM0 = 0xD2511F53;
+constexpr uint32_t kPhiloxM1 = 0xCD9E8D57;
+constexpr uint32_t kPhiloxW0 = 0x9E3779B9;
+constexpr uint32_t kPhiloxW1 = 0xBB67AE85;
+
+constexpr double kTwoPi = 6.283185307179586;
+
+// Maps 64 random bits to a double in (0, 1]. Same trick as in
+// BulkNormalGenerator::refill().
+double to_uniform(uint32_t hi, uint32_t lo) {
+  uint64_t bits = (uint64_t(hi) << 32) | lo;
+  return 2.0 - std::bit_cast<double>((bits >> 12) | 0x3ff0000000000000);
+}
+
+}  // namespace
+
+CounterNormalGenerator::CounterNormalGenerator(uint64_t seed, double mean,
+                                               double stdev)
+    : key_{uint32_t(seed), uint32_t(seed >> 32)}, mean_(mean), stdev_(stdev) {}
+
+// Why blocks? With -ffast-math, the compiler computes most of each Box-Muller
+// loop with SIMD functions, but the last few iterations may use the ordinary
+// ones, and the two can differ in the last bit. If we computed exactly the
+// requested range, value i's position in the loop, and so possibly its last
+// bit, would depend on where the range started. Always computing whole,
+// aligned blocks means value i is computed exactly the same way every time.
+void CounterNormalGenerator::fill(uint64_t first_index,
+                                  std::span<double> out) const {
+  double block[kBlockSize];
+  uint64_t index = first_index;
+  while (!out.empty()) {
+    uint64_t block_number = index / kBlockSize;
+    size_t offset = index % kBlockSize;
+    size_t n = std::min(out.size(), kBlockSize - offset);
+    // Always go through the local buffer, even for a whole block: how the
+    // compiler's SIMD loops treat the first few elements can depend on the
+    // alignment of the output address.
+    compute_block(block_number, block);
+    std::copy_n(block + offset, n, out.begin());
+    index += n;
+    out = out.subspan(n);
+  }
+}
+
+void CounterNormalGenerator::compute_block(uint64_t block, double* out) const {
+  // Each counter produces two uniform numbers u and v, and from them the two
+  // normal numbers at positions 2 * counter and 2 * counter + 1.
+  constexpr size_t kPairs = kBlockSize / 2;
+  double u[kPairs];
+  double v[kPairs];
+  uint64_t first_counter = block * kPairs;
+  for (size_t i = 0; i < kPairs; i++) {
+    uint64_t counter = first_counter + i;
+    uint32_t c0 = uint32_t(counter);
+    uint32_t c1 = uint32_t(counter >> 32);
+    uint32_t c2 = 0;
+    uint32_t c3 = 0;
+    uint32_t k0 = key_[0];
+    uint32_t k1 = key_[1];
+    // Ten rounds of Philox. Each round multiplies two of the words by a
+    // constant (keeping both halves of the 64-bit product), mixes the halves
+    // with the other words and the key, and bumps the key.
+    for (int round = 0; round < 10; round++) {
+      uint64_t p0 = uint64_t(kPhiloxM0) * c0;
+      uint64_t p1 = uint64_t(kPhiloxM1) * c2;
+      uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+      uint32_t n1 = uint32_t(p1);
+      uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+      uint32_t n3 = uint32_t(p0);
+      c0 = n0;
+      c1 = n1;
+      c2 = n2;
+      c3 = n3;
+      k0 += kPhiloxW0;
+      k1 += kPhiloxW1;
+    }
+    u[i] = to_uniform(c0, c1);
+    v[i] = to_uniform(c2, c3);
+  }
+
+  // Box-Muller, as in BulkNormalGenerator::refill(). Even positions get the
+  // cos() half and odd positions the sin() half.
+  double radius[kPairs];
+  for (size_t i = 0; i < kPairs; i++) {
+    radius[i] = stdev_ * std::sqrt(-2.0 * std::log(u[i]));
+  }
+  for (size_t i = 0; i < kPairs; i++) {
+    out[2 * i] = mean_ + radius[i] * std::cos(kTwoPi * v[i]);
+  }
+  for (size_t i = 0; i < kPairs; i++) {
+    out[2 * i + 1] = mean_ + radius[i] * std::sin(kTwoPi * v[i]);
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef COUNTER_NORMAL_H
+#define COUNTER_NORMAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Generates normally distributed random numbers where value i depends only on
+// (seed, i), for RandomNormalDataSource's --generator=philox mode.
+//
+// Ordinary generators like std::mt19937_64 or xoshiro256+ are sequential:
+// value i comes from the state left behind by value i - 1. To split the work
+// across threads we'd have to give each thread its own generator, and then the
+// output would depend on how many threads we used.
+//
+// A counter-based generator has no state. It's a keyed hash function: the
+// "random" bits for position i are just hash(seed, i). Any thread can generate
+// any part of the output directly, and the result is the same no matter how
+// the work is split up. We use Philox4x32-10, from
+//
+//     Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (2011)
+//
+// which is well tested (it passes the BigCrush statistical test suite) and
+// cheap to compute. Each counter value gives 128 random bits, enough for two
+// uniform numbers, which Box-Muller turns into two normal numbers (see
+// bulk_normal.h).
+class CounterNormalGenerator {
+ public:
+  CounterNormalGenerator(uint64_t seed, double mean, double stdev);
+
+  // Fills out with values first_index, first_index + 1, ... of the sequence.
+  // This is const and touches no shared state, so several threads may call it
+  // at once on the same object.
+  void fill(uint64_t first_index, std::span<double> out) const;
+
+ private:
+  // Values are computed in blocks of this many, starting at multiples of
+  // kBlockSize. See fill() for why.
+  static constexpr size_t kBlockSize = 512;
+
+  // Computes block number `block` of the sequence into out[0, kBlockSize).
+  void compute_block(uint64_t block, double* out) const;
+
+  uint32_t key_[2];
+  double mean_;
+  double stdev_;
+};
+
+#endif  // COUNTER_NORMAL_H
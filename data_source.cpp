@@ -1,9 +1,20 @@
+#include <algorithm>
 #include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <limits>
 
+#include <unistd.h>
+
 #include "data_source.h"
 
+#include "byte_scan.h"
+#include "parallel.h"
+#include "parse_double.h"
+
 // A C++11 feature. If you don't need any custom behavior in your constructor or
 // destructor, you can use `= default`.  You'll get the same behavior as if you
 // hadn't written a custom ctor/dtor (mostly).
@@ -14,39 +25,97 @@ DataSource::~DataSource() = default;
 
 // Implementation of the public API method read().
 //
-// This calls do_read(), wrapping it in some C++11 code to measure start and end
-// times.
-std::vector<double> DataSource::read() {
+// This calls do_read_result(), wrapping it in some C++11 code to measure start
+// and end times.
+ReadResult DataSource::read() {
   auto start = std::chrono::system_clock::now();
-  std::vector<double> data = do_read();
+  read_bytes_ = 0;
+  ReadResult data = do_read_result();
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> dur = end - start;
   read_time_ = dur.count();
   return data;
 }
 
+// Like read(), but read_time_ accumulates across calls, so after reading
+// everything in batches it holds the total time spent reading.
+size_t DataSource::read_some(std::span<double> buffer) {
+  auto start = std::chrono::system_clock::now();
+  size_t n = do_read_some(buffer);
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dur = end - start;
+  if (std::isnan(read_time_)) {
+    read_time_ = 0.0;
+  }
+  read_time_ += dur.count();
+  return n;
+}
+
+// The default do_read_some() for subclasses that only implement do_read(). We
+// call do_read() once, keep the whole vector in pending_, and hand it out a
+// buffer at a time. That doesn't save any memory, but it means every
+// DataSource supports read_some(), and subclasses can override do_read_some()
+// to do better when they're ready.
+size_t DataSource::do_read_some(std::span<double> buffer) {
+  if (!pending_read_) {
+    pending_ = do_read();
+    pending_pos_ = 0;
+    pending_read_ = true;
+  }
+  size_t n = std::min(buffer.size(), pending_.size() - pending_pos_);
+  std::copy_n(pending_.begin() + pending_pos_, n, buffer.begin());
+  pending_pos_ += n;
+  return n;
+}
+
+ReadResult DataSource::do_read_result() { return do_read(); }
+
 // A simple getter.
 double DataSource::read_time() const { return read_time_; }
 
+size_t DataSource::read_bytes() const { return read_bytes_; }
+
+void DataSource::add_read_bytes(size_t bytes) { read_bytes_ += bytes; }
+
 // A simple ctor. Initializes read_time_ to NaN ("Not a Number"). See:
 // https://en.wikipedia.org/wiki/NaN
 DataSource::DataSource()
     : read_time_(
-          std::numeric_limits<double>::signaling_NaN()) {}
+          std::numeric_limits<double>::signaling_NaN()),
+      read_bytes_(0),
+      pending_read_(false),
+      pending_pos_(0) {}
 
-// The implementation of do_read for our ReadOneDataSource helper class. It just
-// calls do_read_one() in a loop.
-std::vector<double> ReadOneDataSource::do_read() {
+// Read everything by calling do_read_some() until it returns 0. Each block goes
+// into a small buffer that stays in the L1 cache, and is then appended to the
+// result. Appending a whole block with insert() checks the vector's capacity
+// once per block instead of once per value, like push_back() would.
+std::vector<double> BlockDataSource::do_read() {
+  constexpr size_t kBlockSize = 1024;
+  double block[kBlockSize];
   std::vector<double> data;
-  for (;;) {
+  while (size_t n = do_read_some(block)) {
+    data.insert(data.end(), block, block + n);
+  }
+  return data;
+}
+
+// The implementation of do_read_some for our ReadOneDataSource helper class. It
+// just calls do_read_one() in a loop, until the buffer is full or the data
+// runs out.
+ReadOneDataSource::ReadOneDataSource() : done_(false) {}
+
+size_t ReadOneDataSource::do_read_some(std::span<double> buffer) {
+  size_t n = 0;
+  while (n < buffer.size() && !done_) {
     std::pair<bool, double> one = do_read_one();
-    if (one.first) {
-      data.push_back(one.second);
-    } else {
+    if (!one.first) {
+      done_ = true;
       break;
     }
+    buffer[n++] = one.second;
   }
-  return data;
+  return n;
 }
 
 ConsoleDataSource::ConsoleDataSource(
@@ -68,18 +137,19 @@ std::pair<bool, double> ConsoleDataSource::do_read_one() {
 
     // Try to read a double...
     std::string word;
-    std::cin >> word;
-    if (word == "end") {
-      // Stop if instructed to end.
+    if (!(std::cin >> word) || word == "end") {
+      // Stop if instructed to end, or if there's no more input.
       return std::make_pair(false, 0.0);
     } else {
       // Parse word into a double...
-      char* endptr;
-      double d = std::strtod(word.c_str(), &endptr);
+      double d;
+      const char* word_end = word.data() + word.size();
+      const char* endptr = parse_double(word.data(), word_end, &d);
       // ... on success, endptr points at the first character after the digits
-      // from stdin. That should be a null character if all went well. If the
-      // user typed "123abc", endptr would point at "abc".
-      if (*endptr != '\0') {
+      // from stdin. That should be the end of the word if all went well. If
+      // the user typed "123abc", endptr would point at "abc". On failure,
+      // endptr is nullptr.
+      if (endptr != word_end) {
         std::cout << "Format error; last input ignored"
                   << std::endl;
         // Ignore bad input, try again.
@@ -94,21 +164,892 @@ std::pair<bool, double> ConsoleDataSource::do_read_one() {
 
 // Again, you might want to skip over rng_ and distr_ on your first time through
 // the code. They're from the C++11 random library, which is kind of complex.
+//
+// With no seed, we seed from the clock, so each run is different. We pick the
+// seed once, in seed_, and give the same one to every generator.
 RandomNormalDataSource::RandomNormalDataSource(size_t count,
                                                double mean,
                                                double stdev,
-                                               size_t seed)
-    : rng_(seed ? seed : std::time(nullptr)),
+                                               size_t seed,
+                                               Generator generator,
+                                               size_t threads)
+    : generator_(generator),
+      threads_(std::max<size_t>(threads, 1)),
+      seed_(seed != 0 ? seed : std::time(nullptr)),
+      rng_(seed_),
       distr_(mean, stdev),
-      count_(count) {}
+      bulk_(seed_, mean, stdev),
+      counter_(seed_, mean, stdev),
+      count_(count),
+      generated_(0) {}
 
 // Generate random numbers. Again, feel free to ignore the details of how distr_
 // and rng_ work for now.
 std::vector<double> RandomNormalDataSource::do_read() {
   std::vector<double> data;
   data.resize(count_);
+  if (generator_ == Generator::kBulk) {
+    bulk_.fill(data);
+    return data;
+  }
+  if (generator_ == Generator::kPhilox) {
+    // Give each thread a contiguous slice of data. Since every value depends
+    // only on its index, the slices can be generated in any order.
+    parallel_for(threads_, [this, &data](size_t t) {
+      size_t begin = count_ * t / threads_;
+      size_t end = count_ * (t + 1) / threads_;
+      counter_.fill(begin, std::span<double>(data).subspan(begin, end - begin));
+    });
+    return data;
+  }
   for (size_t i = 0; i < count_; i++) {
     data[i] = distr_(rng_);
   }
   return data;
 }
+
+size_t RandomNormalDataSource::do_read_some(std::span<double> buffer) {
+  size_t n = std::min(buffer.size(), count_ - generated_);
+  if (generator_ == Generator::kBulk) {
+    bulk_.fill(buffer.first(n));
+  } else if (generator_ == Generator::kPhilox) {
+    counter_.fill(generated_, buffer.first(n));
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      buffer[i] = distr_(rng_);
+    }
+  }
+  generated_ += n;
+  return n;
+}
+
+// 1 MB. Large reads mean few system calls; see refill().
+constexpr size_t kStreamBufferBytes = 1 << 20;
+
+StreamDataSource::StreamDataSource(int fd)
+    : fd_(fd), buffer_(kStreamBufferBytes), pos_(0), end_(0), eof_(false) {}
+
+size_t StreamDataSource::do_read_some(std::span<double> out) {
+  auto is_space = [](char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+  };
+  size_t n = 0;
+  while (n < out.size()) {
+    while (pos_ != end_ && is_space(buffer_[pos_])) {
+      ++pos_;
+    }
+    // Find the end of the next word. If the buffer ends in the middle of it,
+    // read more input and try again.
+    const char* word = buffer_.data() + pos_;
+    const char* end = buffer_.data() + end_;
+    const char* word_end = std::find_if(word, end, is_space);
+    if (word_end == end && !eof_) {
+      if (n > 0) {
+        // Return what we have rather than wait for more input: on a live
+        // stream (like `tail -f log | stats --stdin --window=100`), more may
+        // not come for a while, and the caller wants to see these values
+        // now. Only an empty result makes us wait.
+        break;
+      }
+      if (pos_ == 0 && end_ == buffer_.size()) {
+        // The word fills the whole buffer. No number is that long.
+        std::cerr << "Format error; input word too long\n";
+        eof_ = true;
+        break;
+      }
+      refill();
+      continue;
+    }
+    if (word == end) {
+      // End of file.
+      break;
+    }
+    pos_ = word_end - buffer_.data();
+    if (word_end - word == 3 && std::equal(word, word_end, "end")) {
+      eof_ = true;
+      pos_ = end_;
+      break;
+    }
+    if (parse_double(word, word_end, &out[n]) == word_end) {
+      n++;
+    } else {
+      std::cerr << "Format error; '" << std::string(word, word_end)
+                << "' ignored\n";
+    }
+  }
+  return n;
+}
+
+void StreamDataSource::refill() {
+  std::copy(buffer_.begin() + pos_, buffer_.begin() + end_, buffer_.begin());
+  end_ -= pos_;
+  pos_ = 0;
+  for (;;) {
+    ssize_t got = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+    if (got > 0) {
+      end_ += got;
+      add_read_bytes(got);
+      return;
+    }
+    if (got < 0 && errno == EINTR) {
+      // Interrupted by a signal before reading anything; just try again.
+      continue;
+    }
+    if (got < 0) {
+      std::perror("read");
+    }
+    eof_ = true;
+    return;
+  }
+}
+
+namespace {
+
+// The line-by-line parsers shared by the memory-mapped sources
+// (FileDataSource, CsvDataSource) and CompressedDataSource. Each parses the
+// line starting at *pos, where end is the end of the input, and moves *pos to
+// where the next call should start.
+enum class LineStatus { kValue, kBlank, kError };
+
+// One number per line, as in data.txt.
+//
+// parse_double() is the key here. Unlike strtod(), it takes a [first, last)
+// range instead of a null-terminated string, so we can point it into the
+// middle of the mapping without copying each line into a std::string.
+LineStatus parse_number_line(const char** pos, const char* end, double* d) {
+  const char* p = *pos;
+  // Skip blank space, including empty lines and Windows "\r\n" endings.
+  if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+    *pos = p + 1;
+    return LineStatus::kBlank;
+  }
+  const char* num_end = parse_double(p, end, d);
+  bool ok = num_end != nullptr;
+  const char* line_end = std::find(ok ? num_end : p, end, '\n');
+  // Allow trailing blanks after the number, but nothing else.
+  ok = ok && std::all_of(num_end, line_end, [](char c) {
+         return c == ' ' || c == '\t' || c == '\r';
+       });
+  *pos = line_end;
+  return ok ? LineStatus::kValue : LineStatus::kError;
+}
+
+// Parses the CSV field starting at field, which must be exactly a number. A
+// quoted number, like "1.5", is allowed too. Returns a pointer just past it
+// (to the delimiter or newline after it), or nullptr if the field isn't a
+// number.
+const char* parse_csv_field(const char* field, const char* end, char delim,
+                            double* d) {
+  bool quoted = field != end && *field == '"';
+  const char* rest = parse_double(field + quoted, end, d);
+  if (rest == nullptr) {
+    return nullptr;
+  }
+  if (quoted) {
+    if (rest == end || *rest != '"') {
+      return nullptr;
+    }
+    ++rest;
+  }
+  // The number must fill the whole field.
+  if (rest != end && *rest != delim && *rest != '\n' && *rest != '\r') {
+    return nullptr;
+  }
+  return rest;
+}
+
+// One field of one CSV record. We skip straight to the start of the field we
+// want, parse it, then jump to the next record. The fields we don't want are
+// never looked at individually.
+LineStatus parse_csv_record(const char** pos, const char* end, size_t column,
+                            char delim, double* d) {
+  const char* p = *pos;
+  if (*p == '\n' || *p == '\r') {
+    // Blank line.
+    *pos = p + 1;
+    return LineStatus::kBlank;
+  }
+  const char* field = skip_fields(p, end, delim, column);
+  const char* rest =
+      field == nullptr ? nullptr : parse_csv_field(field, end, delim, d);
+  bool ok = rest != nullptr;
+  if (!ok) {
+    // We may have stopped inside a quoted field, so start over from the
+    // beginning of the record to find its end.
+    rest = p;
+  }
+  const char* record_end = find_record_end(rest, end);
+  *pos = record_end == end ? end : record_end + 1;
+  return ok ? LineStatus::kValue : LineStatus::kError;
+}
+
+// Returns the text of the CSV field starting at field, without its quotes, if
+// it has any. The result usually points into the input. Only a field with
+// escaped quotes ("") needs unescaping, into *scratch.
+std::string_view csv_field_text(const char* field, const char* end, char delim,
+                                std::string* scratch) {
+  const char* next = skip_fields(field, end, delim, 1);
+  const char* field_end =
+      next != nullptr ? next - 1 : find_record_end(field, end);
+  if (field_end != field && field_end[-1] == '\r') {
+    // The last field of a record with a Windows "\r\n" ending.
+    --field_end;
+  }
+  if (field == field_end || *field != '"') {
+    return std::string_view(field, field_end - field);
+  }
+  const char* first = field + 1;
+  const char* last = field_end;
+  if (last - first >= 1 && last[-1] == '"') {
+    --last;
+  }
+  std::string_view text(first, last - first);
+  if (text.find('"') == std::string_view::npos) {
+    return text;
+  }
+  scratch->clear();
+  for (size_t i = 0; i < text.size(); i++) {
+    scratch->push_back(text[i]);
+    if (text[i] == '"' && i + 1 < text.size() && text[i + 1] == '"') {
+      i++;
+    }
+  }
+  return *scratch;
+}
+
+// Cuts the CSV data [begin, end) into pieces of about the same size for
+// parsing in parallel, each starting at the start of a record. See
+// CsvDataSource::do_read() for how. Returns pieces + 1 boundaries.
+std::vector<const char*> cut_csv(const char* begin, const char* end,
+                                 size_t pieces) {
+  size_t size = end - begin;
+  // Pass 1: quote counts per share.
+  std::vector<size_t> quotes(pieces, 0);
+  if (pieces > 1) {
+    parallel_for(pieces, [&](size_t t) {
+      quotes[t] = std::count(begin + size * t / pieces,
+                             begin + size * (t + 1) / pieces, '"');
+    });
+  }
+  std::vector<const char*> cuts(pieces + 1);
+  cuts[0] = begin;
+  cuts[pieces] = end;
+  size_t quotes_before = 0;
+  for (size_t t = 1; t < pieces; t++) {
+    quotes_before += quotes[t - 1];
+    const char* start = begin + size * t / pieces;
+    bool quoted = quotes_before % 2 == 1;
+    const char* record_end = find_record_end(start, end, quoted);
+    cuts[t] = record_end == end ? record_end : record_end + 1;
+    // If a single record spans several shares, cuts can go backwards; the
+    // later piece is then empty.
+    cuts[t] = std::max(cuts[t], cuts[t - 1]);
+  }
+  return cuts;
+}
+
+// Copies the pieces parsed by each thread, in order, into one vector, using
+// one thread per piece.
+std::vector<double> concatenate(std::vector<std::vector<double>>& pieces) {
+  size_t threads = pieces.size();
+  if (threads == 1) {
+    return std::move(pieces[0]);
+  }
+  std::vector<size_t> offsets(threads + 1, 0);
+  for (size_t t = 0; t < threads; t++) {
+    offsets[t + 1] = offsets[t] + pieces[t].size();
+  }
+  std::vector<double> data(offsets[threads]);
+  parallel_for(threads, [&data, &offsets, &pieces](size_t t) {
+    std::copy(pieces[t].begin(), pieces[t].end(), data.begin() + offsets[t]);
+  });
+  return data;
+}
+
+}  // namespace
+
+void FormatErrors::add(LineCounter* lines, const char* p) {
+  if (count_ < kMaxMessages) {
+    add("Format error on line " + std::to_string(lines->line(p)) +
+        "; line ignored\n");
+  } else {
+    count_++;
+  }
+}
+
+void FormatErrors::add(LineCounter* lines, const char* p, size_t column) {
+  if (count_ < kMaxMessages) {
+    add("Format error on line " + std::to_string(lines->line(p)) +
+        ", column " + std::to_string(column) + "; value ignored\n");
+  } else {
+    count_++;
+  }
+}
+
+void FormatErrors::add(std::string message) {
+  if (count_++ < kMaxMessages) {
+    messages_.push_back(std::move(message));
+  }
+}
+
+void FormatErrors::append(FormatErrors* other) {
+  size_t unprinted = other->count_ - other->messages_.size();
+  for (std::string& message : other->messages_) {
+    add(std::move(message));
+  }
+  count_ += unprinted;
+  other->messages_.clear();
+  other->count_ = 0;
+}
+
+void FormatErrors::print() {
+  // One << for all of them, so they come out together even if other
+  // readers print at the same time.
+  std::string text;
+  for (const std::string& message : messages_) {
+    text += message;
+  }
+  messages_.clear();
+  std::cerr << text;
+}
+
+void FormatErrors::finish() {
+  print();
+  if (count_ > kMaxMessages) {
+    size_t more = count_ - kMaxMessages;
+    std::cerr << std::to_string(more) +
+                     (more == 1 ? " more field" : " more fields") +
+                     " could not be parsed\n";
+  }
+  count_ = 0;
+}
+
+FileDataSource::FileDataSource(MappedFile file, size_t threads)
+    : file_(std::move(file)),
+      threads_(std::max<size_t>(threads, 1)),
+      pos_(file_.begin()),
+      lines_(file_.begin()) {}
+
+// Parse one number per line, straight out of the mapped file (see
+// parse_number_line() above).
+//
+// With more than one thread, we cut the file into threads_ pieces of about the
+// same number of bytes. A cut will usually land in the middle of a line, so we
+// move each cut forward to the start of the next line; then every line belongs
+// to exactly one piece. Each thread parses its piece into its own vector, and
+// finally the vectors are copied, in order, into the result.
+std::vector<double> FileDataSource::do_read() {
+  const char* begin = file_.begin();
+  size_t size = file_.size();
+  // Byte offsets of the piece boundaries, each at the start of a line.
+  std::vector<const char*> cuts(threads_ + 1);
+  for (size_t t = 0; t <= threads_; t++) {
+    size_t offset = size * t / threads_;
+    if (offset == 0 || offset == size) {
+      cuts[t] = begin + offset;
+    } else {
+      // The line containing offset - 1 belongs to the previous piece.
+      const char* newline = std::find(begin + offset - 1, file_.end(), '\n');
+      cuts[t] = newline == file_.end() ? newline : newline + 1;
+    }
+  }
+
+  std::vector<std::vector<double>> pieces(threads_);
+  std::vector<FormatErrors> errors(threads_);
+  parallel_for(threads_, [this, &cuts, &pieces, &errors](size_t t) {
+    const char* p = cuts[t];
+    LineCounter lines(file_.begin());
+    while (p < cuts[t + 1]) {
+      double d;
+      if (parse_line(&p, &d, &lines, &errors[t])) {
+        pieces[t].push_back(d);
+      }
+    }
+  });
+  for (FormatErrors& piece_errors : errors) {
+    errors_.append(&piece_errors);
+  }
+  errors_.finish();
+  add_read_bytes(size);
+  return concatenate(pieces);
+}
+
+// The same loop as do_read(), but it stops when the buffer is full and
+// remembers where it stopped in pos_.
+size_t FileDataSource::do_read_some(std::span<double> buffer) {
+  const char* start = pos_;
+  size_t n = 0;
+  while (n < buffer.size() && pos_ != file_.end()) {
+    if (parse_line(&pos_, &buffer[n], &lines_, &errors_)) {
+      n++;
+    }
+  }
+  if (pos_ == file_.end()) {
+    errors_.finish();
+  } else {
+    errors_.print();
+  }
+  add_read_bytes(pos_ - start);
+  return n;
+}
+
+bool FileDataSource::parse_line(const char** pos, double* d,
+                                LineCounter* lines,
+                                FormatErrors* errors) const {
+  const char* p = *pos;
+  LineStatus status = parse_number_line(pos, file_.end(), d);
+  if (status == LineStatus::kError) {
+    // Only count lines when something goes wrong, so the common case doesn't
+    // pay for it.
+    errors->add(lines, p);
+  }
+  return status == LineStatus::kValue;
+}
+
+CsvDataSource::CsvDataSource(MappedFile file, size_t column, char delim,
+                             size_t threads)
+    : file_(std::move(file)),
+      column_(column),
+      delim_(delim),
+      threads_(std::max<size_t>(threads, 1)),
+      pos_(file_.begin()),
+      lines_(file_.begin()) {}
+
+// Like FileDataSource::do_read(), we cut the file into threads_ pieces at
+// record boundaries and parse the pieces in parallel. The hard part is finding
+// the boundaries: a newline only ends a record if it isn't inside quotes, and
+// whether a position is inside quotes depends on every quote before it.
+//
+// So we make two passes. First, in cut_csv(), each thread counts the quotes in
+// its share of the file. A position is inside quotes exactly when an odd
+// number of quotes come before it, so adding up the counts of the earlier
+// shares tells each cut point whether it starts inside quotes. From there,
+// find_record_end() finds the first newline that really ends a record, and
+// the piece starts just after it. Then the second pass parses each piece,
+// exactly as a single-threaded parse would.
+std::vector<double> CsvDataSource::do_read() {
+  std::vector<const char*> cuts = cut_csv(file_.begin(), file_.end(), threads_);
+
+  // Pass 2: parse each piece.
+  std::vector<std::vector<double>> pieces(threads_);
+  std::vector<FormatErrors> errors(threads_);
+  parallel_for(threads_, [this, &cuts, &pieces, &errors](size_t t) {
+    const char* p = cuts[t];
+    LineCounter lines(file_.begin());
+    while (p < cuts[t + 1]) {
+      double d;
+      if (parse_line(&p, &d, &lines, &errors[t])) {
+        pieces[t].push_back(d);
+      }
+    }
+  });
+  for (FormatErrors& piece_errors : errors) {
+    errors_.append(&piece_errors);
+  }
+  errors_.finish();
+  add_read_bytes(file_.size());
+  return concatenate(pieces);
+}
+
+size_t CsvDataSource::do_read_some(std::span<double> buffer) {
+  const char* start = pos_;
+  size_t n = 0;
+  while (n < buffer.size() && pos_ != file_.end()) {
+    if (parse_line(&pos_, &buffer[n], &lines_, &errors_)) {
+      n++;
+    }
+  }
+  if (pos_ == file_.end()) {
+    errors_.finish();
+  } else {
+    errors_.print();
+  }
+  add_read_bytes(pos_ - start);
+  return n;
+}
+
+bool CsvDataSource::parse_line(const char** pos, double* d,
+                               LineCounter* lines,
+                               FormatErrors* errors) const {
+  const char* p = *pos;
+  LineStatus status = parse_csv_record(pos, file_.end(), column_, delim_, d);
+  if (status == LineStatus::kError) {
+    errors->add(lines, p);
+  }
+  return status == LineStatus::kValue;
+}
+
+CsvColumnsReader::CsvColumnsReader(MappedFile file, std::vector<size_t> columns,
+                                   char delim, size_t threads)
+    : file_(std::move(file)),
+      columns_(std::move(columns)),
+      delim_(delim),
+      threads_(std::max<size_t>(threads, 1)),
+      read_time_(std::numeric_limits<double>::quiet_NaN()),
+      read_bytes_(0) {}
+
+std::vector<size_t> CsvColumnsReader::numeric_columns(const MappedFile& file,
+                                                      char delim) {
+  std::vector<size_t> columns;
+  const char* p = file.begin();
+  const char* end = file.end();
+  // Skip blank lines.
+  while (p != end && (*p == '\n' || *p == '\r')) {
+    ++p;
+  }
+  for (size_t column = 0; p != nullptr; column++) {
+    double d;
+    if (parse_csv_field(p, end, delim, &d) != nullptr) {
+      columns.push_back(column);
+    }
+    p = skip_fields(p, end, delim, 1);
+  }
+  return columns;
+}
+
+// The same two passes as CsvDataSource::do_read(), except that each thread
+// parses into one vector per column. Then each column is concatenated
+// separately.
+std::vector<std::vector<double>> CsvColumnsReader::read() {
+  auto start = std::chrono::system_clock::now();
+  std::vector<const char*> cuts = cut_csv(file_.begin(), file_.end(), threads_);
+  // pieces[t][i] holds column i from piece t.
+  std::vector<std::vector<std::vector<double>>> pieces(
+      threads_, std::vector<std::vector<double>>(columns_.size()));
+  std::vector<FormatErrors> errors(threads_);
+  parallel_for(threads_, [this, &cuts, &pieces, &errors](size_t t) {
+    const char* p = cuts[t];
+    LineCounter lines(file_.begin());
+    while (p < cuts[t + 1]) {
+      parse_record(&p, pieces[t], &lines, &errors[t]);
+    }
+  });
+  for (size_t t = 1; t < threads_; t++) {
+    errors[0].append(&errors[t]);
+  }
+  errors[0].finish();
+  std::vector<std::vector<double>> data(columns_.size());
+  std::vector<std::vector<double>> column_pieces(threads_);
+  for (size_t i = 0; i < columns_.size(); i++) {
+    for (size_t t = 0; t < threads_; t++) {
+      column_pieces[t] = std::move(pieces[t][i]);
+    }
+    data[i] = concatenate(column_pieces);
+  }
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dur = end - start;
+  read_time_ = dur.count();
+  read_bytes_ = file_.size();
+  return data;
+}
+
+// field always points somewhere in field number `index` of the record, at a
+// spot that isn't inside quotes: either the start of the field, or just past
+// a number we've parsed. From there, skip_fields(field, ..., n) takes us to
+// the start of field index + n, so we can hop from one requested field to the
+// next without looking at the ones in between.
+void CsvColumnsReader::parse_record(const char** pos,
+                                    std::span<std::vector<double>> out,
+                                    LineCounter* lines,
+                                    FormatErrors* errors) const {
+  const char* p = *pos;
+  const char* end = file_.end();
+  if (*p == '\n' || *p == '\r') {
+    // Blank line.
+    *pos = p + 1;
+    return;
+  }
+  const char* field = p;
+  size_t index = 0;
+  for (size_t i = 0; i < columns_.size(); i++) {
+    const char* next = skip_fields(field, end, delim_, columns_[i] - index);
+    double d;
+    const char* number_end =
+        next == nullptr ? nullptr : parse_csv_field(next, end, delim_, &d);
+    if (number_end == nullptr) {
+      // Not a number, or the record is too short.
+      if (next == nullptr) {
+        // All of the remaining columns are missing.
+        for (; i < columns_.size(); i++) {
+          errors->add(lines, p, columns_[i]);
+        }
+        break;
+      }
+      errors->add(lines, p, columns_[i]);
+      field = next;
+    } else {
+      out[i].push_back(d);
+      field = number_end;
+    }
+    index = columns_[i];
+  }
+  const char* record_end = find_record_end(field, end);
+  *pos = record_end == end ? end : record_end + 1;
+}
+
+CsvGroupReader::CsvGroupReader(MappedFile file, size_t key_column,
+                               size_t value_column, char delim, size_t threads)
+    : file_(std::move(file)),
+      key_column_(key_column),
+      value_column_(value_column),
+      delim_(delim),
+      threads_(std::max<size_t>(threads, 1)),
+      read_time_(std::numeric_limits<double>::quiet_NaN()),
+      read_bytes_(0),
+      read_count_(0) {}
+
+GroupTable CsvGroupReader::read() {
+  auto start = std::chrono::system_clock::now();
+  std::vector<const char*> cuts = cut_csv(file_.begin(), file_.end(), threads_);
+  std::vector<GroupTable> tables(threads_);
+  std::vector<size_t> counts(threads_, 0);
+  std::vector<FormatErrors> errors(threads_);
+  parallel_for(threads_, [this, &cuts, &tables, &counts, &errors](size_t t) {
+    std::string scratch;
+    const char* p = cuts[t];
+    LineCounter lines(file_.begin());
+    while (p < cuts[t + 1]) {
+      counts[t] += parse_record(&p, &tables[t], &scratch, &lines, &errors[t]);
+    }
+  });
+  for (size_t t = 1; t < threads_; t++) {
+    errors[0].append(&errors[t]);
+  }
+  errors[0].finish();
+  // Most keys usually show up in every piece, so merging costs about one
+  // lookup per key per thread: nothing, next to parsing.
+  for (size_t t = 1; t < threads_; t++) {
+    tables[0].merge(tables[t]);
+  }
+  read_count_ = 0;
+  for (size_t count : counts) {
+    read_count_ += count;
+  }
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> dur = end - start;
+  read_time_ = dur.count();
+  read_bytes_ = file_.size();
+  return std::move(tables[0]);
+}
+
+bool CsvGroupReader::parse_record(const char** pos, GroupTable* table,
+                                  std::string* scratch, LineCounter* lines,
+                                  FormatErrors* errors) const {
+  const char* p = *pos;
+  const char* end = file_.end();
+  if (*p == '\n' || *p == '\r') {
+    // Blank line.
+    *pos = p + 1;
+    return false;
+  }
+  // Find both fields, hopping from the first to the second as in
+  // CsvColumnsReader::parse_record().
+  bool key_first = key_column_ < value_column_;
+  size_t first = key_first ? key_column_ : value_column_;
+  size_t second = key_first ? value_column_ : key_column_;
+  const char* first_field = skip_fields(p, end, delim_, first);
+  const char* second_field =
+      first_field == nullptr
+          ? nullptr
+          : skip_fields(first_field, end, delim_, second - first);
+  bool ok = second_field != nullptr;
+  double d;
+  if (ok) {
+    const char* key_field = key_first ? first_field : second_field;
+    const char* value_field = key_first ? second_field : first_field;
+    ok = parse_csv_field(value_field, end, delim_, &d) != nullptr;
+    if (ok) {
+      table->find_or_add(csv_field_text(key_field, end, delim_, scratch))
+          .add(d);
+    }
+  }
+  if (!ok) {
+    errors->add(lines, p);
+  }
+  // The start of a field is never inside quotes, so we can look for the end
+  // of the record from there.
+  const char* record_end = find_record_end(ok ? second_field : p, end);
+  *pos = record_end == end ? end : record_end + 1;
+  return ok;
+}
+
+CompressedDataSource::CompressedDataSource(MappedFile file,
+                                           Compression compression,
+                                           uint64_t column, char delim)
+    : decompressor_(std::move(file), compression),
+      column_(column),
+      delim_(delim),
+      pos_(0),
+      complete_(0),
+      line_(1),
+      quoted_(false),
+      eof_(false) {}
+
+size_t CompressedDataSource::do_read_some(std::span<double> out) {
+  size_t n = 0;
+  while (n < out.size()) {
+    if (pos_ == complete_) {
+      if (eof_) {
+        break;
+      }
+      refill();
+      continue;
+    }
+    const char* base = buffer_.data();
+    const char* p = base + pos_;
+    const char* start = p;
+    const char* end = base + complete_;
+    LineStatus status =
+        column_ == kNoColumn
+            ? parse_number_line(&p, end, &out[n])
+            : parse_csv_record(&p, end, column_, delim_, &out[n]);
+    if (status == LineStatus::kValue) {
+      n++;
+    } else if (status == LineStatus::kError) {
+      LineCounter lines(start, line_);
+      errors_.add(&lines, start);
+    }
+    // A number's line ends at the newline, which the next call passes as a
+    // blank line; a CSV record ends just after its newline.
+    if (quoted_) {
+      line_ += std::count(start, p, '\n');
+    } else if (p != start && p[-1] == '\n') {
+      line_++;
+    }
+    pos_ = p - base;
+  }
+  if (eof_ && pos_ == complete_) {
+    errors_.finish();
+  } else {
+    errors_.print();
+  }
+  return n;
+}
+
+void CompressedDataSource::refill() {
+  buffer_.erase(buffer_.begin(), buffer_.begin() + pos_);
+  pos_ = 0;
+  // Count the compressed bytes behind each chunk, like the mapped-file
+  // sources count the bytes of the file, so MB/s means the same for both.
+  size_t input_before = decompressor_.input_bytes();
+  bool more = decompressor_.read_chunk(&buffer_);
+  add_read_bytes(decompressor_.input_bytes() - input_before);
+  const char* begin = buffer_.data();
+  const char* p = begin + buffer_.size();
+  size_t quotes = column_ == kNoColumn ? 0 : std::count(begin, p, '"');
+  quoted_ = quotes > 0;
+  if (!more) {
+    eof_ = true;
+    if (decompressor_.failed()) {
+      std::cerr << "Error decompressing input; the data may be incomplete\n";
+    }
+    // Whatever is left is the last line, even without a final newline.
+    complete_ = buffer_.size();
+    return;
+  }
+  // Find the end of the last complete line. For a CSV file, a newline inside
+  // quotes doesn't end a record. buffer_ starts at the start of a record, so a
+  // newline ends one exactly when an even number of quotes come before it. We
+  // counted all the quotes above, so we walk back from the end, subtracting
+  // the ones we pass.
+  while (p != begin) {
+    --p;
+    if (*p == '\n' && quotes % 2 == 0) {
+      complete_ = p + 1 - begin;
+      return;
+    }
+    quotes -= *p == '"';
+  }
+  complete_ = 0;
+}
+
+BinaryDataSource::BinaryDataSource(MappedFile file, BinaryData data)
+    : file_(std::move(file)), data_(data), pos_(0) {}
+
+BinaryDataSource::BinaryDataSource(MappedFile file,
+                                   std::span<const double> values)
+    : BinaryDataSource(std::move(file),
+                       BinaryData{BinaryType::kFloat64, values, {}}) {}
+
+std::vector<double> BinaryDataSource::do_read() {
+  add_read_bytes(file_.size());
+  if (data_.type == BinaryType::kFloat64) {
+    return std::vector<double>(data_.doubles.begin(), data_.doubles.end());
+  }
+  return std::vector<double>(data_.floats.begin(), data_.floats.end());
+}
+
+// Borrowing means read() doesn't touch the values at all. The OS pages them in
+// as the statistics code first reads them, so for a big file that's where the
+// disk time shows up, not in read_time().
+ReadResult BinaryDataSource::do_read_result() {
+  if (data_.type != BinaryType::kFloat64) {
+    return do_read();
+  }
+  add_read_bytes(file_.size());
+  return ReadResult(data_.doubles);
+}
+
+size_t BinaryDataSource::do_read_some(std::span<double> buffer) {
+  size_t n = std::min(buffer.size(), data_.size() - pos_);
+  if (data_.type == BinaryType::kFloat64) {
+    std::copy_n(data_.doubles.begin() + pos_, n, buffer.begin());
+    add_read_bytes(n * sizeof(double));
+  } else {
+    std::copy_n(data_.floats.begin() + pos_, n, buffer.begin());
+    add_read_bytes(n * sizeof(float));
+  }
+  pos_ += n;
+  return n;
+}
+
+CacheWritingDataSource::CacheWritingDataSource(
+    std::unique_ptr<DataSource> source, const std::string& cache_path,
+    const CacheKey& key)
+    : source_(std::move(source)), writing_(true) {
+  if (!writer_.open(cache_path, key)) {
+    std::cerr << "Warning: could not create cache file '" << cache_path
+              << "'\n";
+    writing_ = false;
+  }
+}
+
+std::vector<double> CacheWritingDataSource::do_read() {
+  return do_read_result().take();
+}
+
+ReadResult CacheWritingDataSource::do_read_result() {
+  ReadResult data = source_->read();
+  add_read_bytes(source_->read_bytes());
+  append(data.values());
+  commit();
+  return data;
+}
+
+size_t CacheWritingDataSource::do_read_some(std::span<double> buffer) {
+  // The wrapped source counts its bytes across read_some() calls, so pass on
+  // just the bytes from this call.
+  size_t bytes_before = source_->read_bytes();
+  size_t n = source_->read_some(buffer);
+  add_read_bytes(source_->read_bytes() - bytes_before);
+  if (n == 0) {
+    commit();
+  } else {
+    append(buffer.first(n));
+  }
+  return n;
+}
+
+void CacheWritingDataSource::append(std::span<const double> values) {
+  if (writing_ && !writer_.append(values)) {
+    std::cerr << "Warning: error writing cache file; not caching\n";
+    writing_ = false;
+  }
+}
+
+void CacheWritingDataSource::commit() {
+  if (writing_ && !writer_.commit()) {
+    std::cerr << "Warning: error writing cache file; not caching\n";
+  }
+  writing_ = false;
+}
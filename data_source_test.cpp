@@ -0,0 +1,499 @@
+// Checks the helper classes in data_source.h for sources that produce values
+// one at a time or a block at a time, and times them against each other. Run
+// it with `make check`.
+//
+// The same trivial source, counting 0, 1, 2, ..., is written three ways:
+//
+// - On ReadOneDataSource: one virtual do_read_one() call per value.
+// - On BlockDataSource: one virtual do_read_some() call per block.
+// - On InlineReadOneDataSource: one read_one() call per value, which the
+//   compiler can inline, since it knows the type.
+//
+// A real source does more work per value than counting, so the differences
+// shrink, but this shows what the per-value overhead itself costs.
+//
+// It also checks that the sources that parse a file on several threads give
+// exactly the values, in exactly the order, that a sequential parse would, no
+// matter where the cuts between the threads' pieces land.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include "data_source.h"
+
+namespace {
+
+class VirtualCounter : public ReadOneDataSource {
+ public:
+  explicit VirtualCounter(size_t count)
+      : count_(count), next_(0), calls_after_end_(0) {}
+
+  // How many times do_read_one() was called after reporting the end.
+  size_t calls_after_end() const { return calls_after_end_; }
+
+ private:
+  size_t count_;
+  size_t next_;
+  size_t calls_after_end_;
+
+  std::pair<bool, double> do_read_one() override {
+    if (next_ == count_) {
+      calls_after_end_++;
+      return {false, 0.0};
+    }
+    return {true, static_cast<double>(next_++)};
+  }
+};
+
+class BlockCounter : public BlockDataSource {
+ public:
+  explicit BlockCounter(size_t count) : count_(count), next_(0) {}
+
+ private:
+  size_t count_;
+  size_t next_;
+
+  size_t do_read_some(std::span<double> buffer) override {
+    size_t n = std::min(buffer.size(), count_ - next_);
+    for (size_t i = 0; i < n; i++) {
+      buffer[i] = static_cast<double>(next_++);
+    }
+    return n;
+  }
+};
+
+class InlineCounter : public InlineReadOneDataSource<InlineCounter> {
+ public:
+  explicit InlineCounter(size_t count) : count_(count), next_(0) {}
+
+  bool read_one(double* out) {
+    if (next_ == count_) {
+      return false;
+    }
+    *out = static_cast<double>(next_++);
+    return true;
+  }
+
+ private:
+  size_t count_;
+  size_t next_;
+};
+
+const char* const kTempPath = "data_source_test.tmp";
+const char* const kErrorPath = "data_source_test.err";
+
+int failures = 0;
+
+// read_some_rate() stores results here, so the compiler can't skip the work.
+volatile double sink;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+// Whether values are exactly 0, 1, ..., count - 1.
+bool counts_up(std::span<const double> values, size_t count) {
+  if (values.size() != count) {
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (values[i] != static_cast<double>(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reads everything from source with read_some(), batch_size values at a
+// time.
+std::vector<double> read_all_some(DataSource& source, size_t batch_size) {
+  std::vector<double> values;
+  std::vector<double> buffer(batch_size);
+  while (size_t n = source.read_some(buffer)) {
+    values.insert(values.end(), buffer.begin(), buffer.begin() + n);
+  }
+  return values;
+}
+
+void write_file(const std::string& text) {
+  std::FILE* file = std::fopen(kTempPath, "wb");
+  std::fwrite(text.data(), 1, text.size(), file);
+  std::fclose(file);
+}
+
+// Reads text with FileDataSource, or as a CSV file with CsvDataSource if
+// column isn't kNoColumn: all at once with read() on threads threads if
+// batch_size is 0, and otherwise with read_some(), batch_size values at a
+// time.
+std::vector<double> read_text(const std::string& text, uint64_t column,
+                              size_t threads, size_t batch_size) {
+  write_file(text);
+  MappedFile file;
+  if (!file.open(kTempPath)) {
+    fail(std::string("Can't open ") + kTempPath);
+    return {};
+  }
+  std::unique_ptr<DataSource> source;
+  if (column == kNoColumn) {
+    source = std::make_unique<FileDataSource>(std::move(file), threads);
+  } else {
+    source = std::make_unique<CsvDataSource>(std::move(file), column, ',',
+                                             threads);
+  }
+  if (batch_size == 0) {
+    return source->read().take();
+  }
+  return read_all_some(*source, batch_size);
+}
+
+// text, gzipped as decompress_test does.
+std::string gzip(const std::string& text) {
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  // 15 + 16 asks for a gzip header rather than a zlib one.
+  deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+               Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(&zs, text.size()), '\0');
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+  zs.avail_in = text.size();
+  zs.next_out = reinterpret_cast<Bytef*>(out.data());
+  zs.avail_out = out.size();
+  deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return out;
+}
+
+// Reads text gzipped, with CompressedDataSource, batch_size values at a time.
+std::vector<double> read_gzipped_text(const std::string& text, uint64_t column,
+                                      size_t batch_size) {
+  write_file(gzip(text));
+  MappedFile file;
+  if (!file.open(kTempPath)) {
+    fail(std::string("Can't open ") + kTempPath);
+    return {};
+  }
+  CompressedDataSource source(std::move(file), Compression::kGzip, column);
+  return read_all_some(source, batch_size);
+}
+
+// Checks that every way of reading text gives expected, as in read_text().
+void check_text(const std::string& what, const std::string& text,
+                uint64_t column, const std::vector<double>& expected) {
+  std::string name = column == kNoColumn ? "FileDataSource" : "CsvDataSource";
+  for (size_t threads = 1; threads <= 8; threads++) {
+    if (read_text(text, column, threads, 0) != expected) {
+      fail(name + " read() is wrong for " + what + " on " +
+           std::to_string(threads) + " threads");
+    }
+  }
+  for (size_t batch_size : {1, 7, 4096}) {
+    if (read_text(text, column, 1, batch_size) != expected) {
+      fail(name + " read_some() is wrong for " + what + " in batches of " +
+           std::to_string(batch_size));
+    }
+  }
+}
+
+// Returns text with '|' removed and blank lines (which hold no values) added
+// at the start or end, so that the cut between two threads' pieces lands
+// exactly where the '|' was. Text without a '|' is returned as it is.
+std::string cut_at_bar(const std::string& text) {
+  size_t cut = text.find('|');
+  if (cut == std::string::npos) {
+    return text;
+  }
+  std::string rest = text.substr(0, cut) + text.substr(cut + 1);
+  size_t tail = rest.size() - cut;
+  if (cut < tail) {
+    return std::string(tail - cut, '\n') + rest;
+  }
+  return rest + std::string(cut - tail, '\n');
+}
+
+// A CSV field for the columns we don't read. Some are quoted, and hold
+// delimiters, newlines (both kinds) and escaped quotes, which mustn't be
+// mistaken for the ends of fields or records.
+std::string random_text_field(std::mt19937_64* rng) {
+  static const char* const kPieces[] = {"abc", ",", "\n", "\r\n", "\"\"",
+                                        " ", "1.5"};
+  if ((*rng)() % 4 != 0) {
+    return "w" + std::to_string((*rng)() % 1000);
+  }
+  std::string field = "\"";
+  for (size_t n = (*rng)() % 6; n > 0; n--) {
+    field += kPieces[(*rng)() % std::size(kPieces)];
+  }
+  return field + "\"";
+}
+
+// Runs f() with stderr redirected to a file, and returns what it wrote.
+template <typename F>
+std::string capture_stderr(const F& f) {
+  std::fflush(stderr);
+  int saved = dup(STDERR_FILENO);
+  std::FILE* file = std::fopen(kErrorPath, "w+");
+  dup2(fileno(file), STDERR_FILENO);
+  f();
+  std::fflush(stderr);
+  dup2(saved, STDERR_FILENO);
+  close(saved);
+  std::rewind(file);
+  std::string text;
+  char buf[4096];
+  while (size_t n = std::fread(buf, 1, sizeof(buf), file)) {
+    text.append(buf, n);
+  }
+  std::fclose(file);
+  std::remove(kErrorPath);
+  return text;
+}
+
+void check_file_source(std::mt19937_64* rng) {
+  // The last line needn't end with a newline, blank lines hold no values, and
+  // a cut right before, on or after a newline must start the next piece at
+  // the next line.
+  std::vector<double> expected = {1, 2, 3};
+  const char* const cases[] = {
+      "1\n2\n3",
+      "\n\n1\n\n2\r\n\r\n  3\t\r\n\n",
+      "1\n|2\n3\n",
+      "1|\n2\n3\n",
+      "1\n\n|\n2\n3",
+      "1\r|\n2\r\n3\r\n",
+      "1\n2\n3|",
+  };
+  for (const char* text : cases) {
+    std::string what = "'" + std::string(text) + "'";
+    check_text(what, cut_at_bar(text), kNoColumn, expected);
+  }
+
+  std::normal_distribution<double> normal(0.0, 1.0);
+  std::string text;
+  expected.clear();
+  char buf[32];
+  for (size_t i = 0; i < 200000; i++) {
+    if ((*rng)() % 50 == 0) {
+      text += (*rng)() % 2 == 0 ? "\n" : "\r\n";
+      continue;
+    }
+    double d = normal(*rng);
+    expected.push_back(d);
+    text.append(buf, std::snprintf(buf, sizeof(buf), "%.17g\n", d));
+  }
+  text.pop_back();
+  check_text("a file of 200000 lines", text, kNoColumn, expected);
+
+  // Format errors give the line number in the whole file, whichever thread's
+  // piece the line is in. Only the first FormatErrors::kMaxMessages are
+  // printed, the first ones in the file on any number of threads, and then a
+  // count of the rest. That's the same for a CSV file's column 0.
+  text.clear();
+  expected.clear();
+  std::string errors;
+  size_t bad_lines = 0;
+  for (size_t line = 1; line <= 2000; line++) {
+    if (line % 100 == 1 || line == 1000 || line == 2000) {
+      text += "oops\n";
+      if (++bad_lines <= FormatErrors::kMaxMessages) {
+        errors += "Format error on line " + std::to_string(line) +
+                  "; line ignored\n";
+      }
+    } else {
+      expected.push_back(line);
+      text += std::to_string(line) + (line % 3 == 0 ? "\r\n" : "\n");
+    }
+  }
+  errors += std::to_string(bad_lines - FormatErrors::kMaxMessages) +
+            " more fields could not be parsed\n";
+  for (uint64_t column : {kNoColumn, uint64_t(0)}) {
+    std::string name =
+        column == kNoColumn ? "FileDataSource" : "CsvDataSource";
+    for (size_t threads = 1; threads <= 8; threads++) {
+      std::vector<double> values;
+      std::string reported = capture_stderr(
+          [&] { values = read_text(text, column, threads, 0); });
+      if (values != expected || reported != errors) {
+        fail(name + " reports the wrong errors on " +
+             std::to_string(threads) + " threads:\n" + reported);
+      }
+    }
+    std::string reported =
+        capture_stderr([&] { read_text(text, column, 1, 7); });
+    if (reported != errors) {
+      fail(name + " read_some() reports the wrong errors:\n" + reported);
+    }
+  }
+}
+
+void check_csv_source(std::mt19937_64* rng) {
+  // Cuts in the places that are easy to get wrong: inside quotes (where a
+  // newline doesn't end the record), just after an escaped quote (which
+  // leaves us inside quotes), and around a Windows "\r\n" ending.
+  std::vector<double> expected = {1, 2, 3};
+  const char* const cases[] = {
+      "a,1\n\"x,\n|y\",2\nb,3\n",
+      "a,1\n\"x|,\ny\",2\nb,3\n",
+      "a,1\n\"q\"\"|,\n\",2\nb,3\n",
+      "a,1\n\"q\"\"|\",2\nb,3\n",
+      "a,1\n\"q\"\"\"|,2\nb,3\n",
+      "a,1|\r\nb,2\r\nc,3\r\n",
+      "a,1\r|\nb,2\r\nc,3\r\n",
+      "a,1\r\n|b,2\r\nc,3\r\n",
+      "a,\"1\"\r\n\"\r|\n\",2\r\nc,3",
+  };
+  for (const char* text : cases) {
+    std::string what = "'" + std::string(text) + "'";
+    check_text(what, cut_at_bar(text), 1, expected);
+  }
+
+  // A big file full of those, so the cuts land everywhere.
+  std::normal_distribution<double> normal(0.0, 1.0);
+  std::string text;
+  expected.clear();
+  char buf[32];
+  for (size_t i = 0; i < 200000; i++) {
+    if ((*rng)() % 50 == 0) {
+      text += "\n";
+      continue;
+    }
+    double d = normal(*rng);
+    expected.push_back(d);
+    // Some of the numbers are quoted, too.
+    const char* quote = (*rng)() % 8 == 0 ? "\"" : "";
+    text += random_text_field(rng);
+    text += ',';
+    text += quote;
+    text.append(buf, std::snprintf(buf, sizeof(buf), "%.17g", d));
+    text += quote;
+    text += ',';
+    text += random_text_field(rng);
+    text += (*rng)() % 2 == 0 ? "\n" : "\r\n";
+  }
+  check_text("a file of 200000 records", text, 1, expected);
+}
+
+// CompressedDataSource only sees a chunk of the file at a time, so it counts
+// lines as it goes rather than from the start of the file. Format errors past
+// the first few chunks must still give the same line numbers, and values, as
+// reading the file uncompressed.
+void check_compressed_source(std::mt19937_64* rng) {
+  for (uint64_t column : {kNoColumn, uint64_t(1)}) {
+    std::string text;
+    for (size_t i = 0; i < 400000; i++) {
+      if (column != kNoColumn) {
+        text += random_text_field(rng) + ",";
+      }
+      text += (*rng)() % 50000 == 0 ? "oops" : std::to_string(i);
+      text += (*rng)() % 2 == 0 ? "\n" : "\r\n";
+    }
+    std::string what = column == kNoColumn ? "a data.txt file" : "a CSV file";
+    std::vector<double> expected;
+    std::string errors =
+        capture_stderr([&] { expected = read_text(text, column, 1, 0); });
+    for (size_t batch_size : {7, 4096}) {
+      std::vector<double> values;
+      std::string reported = capture_stderr(
+          [&] { values = read_gzipped_text(text, column, batch_size); });
+      if (values != expected || reported != errors) {
+        fail("CompressedDataSource is wrong for " + what + " in batches of " +
+             std::to_string(batch_size) + ":\n" + reported);
+      }
+    }
+  }
+}
+
+template <typename Counter>
+void check(const char* name) {
+  for (size_t count : {0, 1, 1023, 1024, 1025, 100000}) {
+    Counter by_read(count);
+    if (!counts_up(by_read.read().values(), count)) {
+      fail(std::string(name) + " read() is wrong for " +
+           std::to_string(count) + " values");
+    }
+    for (size_t batch_size : {1, 7, 4096}) {
+      Counter by_batch(count);
+      if (!counts_up(read_all_some(by_batch, batch_size), count)) {
+        fail(std::string(name) + " read_some() is wrong for " +
+             std::to_string(count) + " values in batches of " +
+             std::to_string(batch_size));
+      }
+    }
+  }
+}
+
+// Values per second for reading count values from a Counter with
+// read_some() into a 4096-value buffer, the fastest of a few runs.
+template <typename Counter>
+double read_some_rate(size_t count) {
+  double best = HUGE_VAL;
+  double sum = 0.0;
+  std::vector<double> buffer(4096);
+  for (int run = 0; run < 3; run++) {
+    Counter source(count);
+    auto start = std::chrono::steady_clock::now();
+    while (size_t n = source.read_some(buffer)) {
+      // Touch the values, as a real consumer would.
+      sum += buffer[n - 1];
+    }
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, time.count());
+  }
+  sink = sum;
+  return count / best;
+}
+
+}  // namespace
+
+int main() {
+  check<VirtualCounter>("ReadOneDataSource");
+  check<BlockCounter>("BlockDataSource");
+  check<InlineCounter>("InlineReadOneDataSource");
+
+  // ReadOneDataSource promises never to call do_read_one() again once it has
+  // reported the end (for the console, that would print another prompt).
+  VirtualCounter counter(10);
+  read_all_some(counter, 3);
+  std::vector<double> buffer(3);
+  counter.read_some(buffer);
+  if (counter.calls_after_end() != 1) {
+    fail("ReadOneDataSource called do_read_one() " +
+         std::to_string(counter.calls_after_end()) + " times after the end");
+  }
+
+  std::mt19937_64 rng(42);
+  check_file_source(&rng);
+  check_csv_source(&rng);
+  check_compressed_source(&rng);
+  std::remove(kTempPath);
+
+  if (failures > 0) {
+    std::cerr << "data_source: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "data_source: all checks passed\n";
+
+  size_t count = 100000000;
+  std::printf("%-24s %.2g values/s\n", "ReadOneDataSource",
+              read_some_rate<VirtualCounter>(count));
+  std::printf("%-24s %.2g values/s\n", "BlockDataSource",
+              read_some_rate<BlockCounter>(count));
+  std::printf("%-24s %.2g values/s\n", "InlineReadOneDataSource",
+              read_some_rate<InlineCounter>(count));
+  return 0;
+}
@@ -0,0 +1,220 @@
+#include "decompress.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <utility>
+
+#include <zlib.h>
+#ifdef STATS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+Compression detect_compression(const MappedFile& file) {
+  const unsigned char* p =
+      reinterpret_cast<const unsigned char*>(file.begin());
+  if (file.size() >= 2 && p[0] == 0x1f && p[1] == 0x8b) {
+    return Compression::kGzip;
+  }
+  if (file.size() >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f &&
+      p[3] == 0xfd) {
+    return Compression::kZstd;
+  }
+  return Compression::kNone;
+}
+
+bool compression_supported(Compression compression) {
+  switch (compression) {
+    case Compression::kNone:
+    case Compression::kGzip:
+      return true;
+    case Compression::kZstd:
+#ifdef STATS_HAVE_ZSTD
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+Decompressor::Decompressor(MappedFile file, Compression compression)
+    : file_(std::move(file)),
+      compression_(compression),
+      slots_(kSlots, std::vector<char>(kChunkSize)),
+      sizes_(kSlots),
+      ends_(kSlots),
+      head_(0),
+      tail_(0),
+      done_(false),
+      stop_(false),
+      failed_(false),
+      input_bytes_(0),
+      thread_(&Decompressor::run, this) {}
+
+Decompressor::~Decompressor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+bool Decompressor::read_chunk(std::vector<char>* out) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return head_ != tail_ || done_; });
+  if (head_ == tail_) {
+    return false;
+  }
+  // Copy the chunk out while holding the lock. The thread never touches a
+  // published slot, so we could copy without it, but then we'd need to lock
+  // again afterwards; a 1 MB copy is quick compared to decompressing it.
+  const std::vector<char>& slot = slots_[tail_ % kSlots];
+  out->insert(out->end(), slot.begin(), slot.begin() + sizes_[tail_ % kSlots]);
+  input_bytes_ = ends_[tail_ % kSlots];
+  tail_++;
+  lock.unlock();
+  cv_.notify_all();
+  return true;
+}
+
+bool Decompressor::failed() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failed_;
+}
+
+char* Decompressor::begin_write() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return head_ - tail_ < kSlots || stop_; });
+  return stop_ ? nullptr : slots_[head_ % kSlots].data();
+}
+
+void Decompressor::end_write(size_t n, size_t end) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sizes_[head_ % kSlots] = n;
+    ends_[head_ % kSlots] = end;
+    head_++;
+  }
+  cv_.notify_all();
+}
+
+void Decompressor::finish(bool ok) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+    failed_ = !ok;
+  }
+  cv_.notify_all();
+}
+
+void Decompressor::run() {
+  bool ok = compression_ == Compression::kGzip ? run_gzip() : run_zstd();
+  finish(ok);
+}
+
+// zlib's z_stream keeps pointers to the next input and output bytes and how
+// many are left (avail_in, avail_out). Each inflate() call decompresses as much
+// as it can and advances them.
+bool Decompressor::run_gzip() {
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  // 15 is the largest window size, and adding 32 makes zlib detect the gzip
+  // (or zlib) header itself.
+  if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+    return false;
+  }
+  // avail_in is an unsigned int, so we feed files bigger than 4 GB in pieces.
+  const char* in = file_.begin();
+  size_t in_left = file_.size();
+  bool stream_end = false;
+  bool ok = true;
+  while (ok) {
+    char* chunk = begin_write();
+    if (chunk == nullptr) {
+      break;
+    }
+    zs.next_out = reinterpret_cast<Bytef*>(chunk);
+    zs.avail_out = kChunkSize;
+    bool at_end = false;
+    while (zs.avail_out > 0) {
+      if (zs.avail_in == 0) {
+        if (in_left == 0) {
+          // Out of input. That's only OK right after the end of a stream.
+          at_end = true;
+          ok = stream_end;
+          break;
+        }
+        size_t n = std::min<size_t>(in_left, UINT_MAX);
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        zs.avail_in = n;
+        in += n;
+        in_left -= n;
+      }
+      int ret = inflate(&zs, Z_NO_FLUSH);
+      stream_end = ret == Z_STREAM_END;
+      if (stream_end) {
+        // `cat a.gz b.gz > c.gz` makes a valid gzip file, with one stream
+        // after another, so keep going if there's more input.
+        if (zs.avail_in > 0 || in_left > 0) {
+          inflateReset(&zs);
+        }
+      } else if (ret != Z_OK) {
+        at_end = true;
+        ok = false;
+        break;
+      }
+    }
+    // zlib has consumed everything we've fed it except avail_in bytes.
+    end_write(kChunkSize - zs.avail_out,
+              in - file_.begin() - static_cast<size_t>(zs.avail_in));
+    if (at_end) {
+      break;
+    }
+  }
+  inflateEnd(&zs);
+  return ok;
+}
+
+bool Decompressor::run_zstd() {
+#ifdef STATS_HAVE_ZSTD
+  ZSTD_DStream* stream = ZSTD_createDStream();
+  if (stream == nullptr) {
+    return false;
+  }
+  ZSTD_initDStream(stream);
+  ZSTD_inBuffer in = {file_.begin(), file_.size(), 0};
+  // ZSTD_decompressStream() returns 0 once a frame is completely decoded and
+  // flushed, and some positive number if it needs more input or more room.
+  size_t ret = 0;
+  bool ok = true;
+  bool at_end = false;
+  while (!at_end) {
+    char* chunk = begin_write();
+    if (chunk == nullptr) {
+      break;
+    }
+    ZSTD_outBuffer out = {chunk, kChunkSize, 0};
+    while (out.pos < out.size) {
+      if (in.pos == in.size && ret == 0) {
+        at_end = true;
+        break;
+      }
+      ret = ZSTD_decompressStream(stream, &out, &in);
+      if (ZSTD_isError(ret) ||
+          (in.pos == in.size && ret != 0 && out.pos < out.size)) {
+        // Either corrupt, or it wants more input and there isn't any.
+        at_end = true;
+        ok = false;
+        break;
+      }
+    }
+    end_write(out.pos, in.pos);
+  }
+  ZSTD_freeDStream(stream);
+  return ok;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,108 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Reading compressed input files (data.txt.gz, test.csv.zst, ...) without
+// decompressing them to disk first.
+//
+// gzip support uses zlib, which every system we care about has. zstd support
+// needs libzstd; the Makefile turns it on (by defining STATS_HAVE_ZSTD) only if
+// zstd.h is installed.
+
+enum class Compression {
+  kNone,
+  kGzip,
+  kZstd,
+};
+
+// Looks at the first few bytes of file (its "magic number") to tell whether
+// it's compressed, and how. The file name doesn't matter.
+Compression detect_compression(const MappedFile& file);
+
+// Whether this build can decompress the given format.
+bool compression_supported(Compression compression);
+
+// Decompresses a memory-mapped file on a background thread, a chunk at a time.
+//
+// The thread decompresses into a small ring of fixed-size chunks while the
+// caller parses earlier ones, so decompression and parsing overlap, and the
+// kernel reads the compressed file ahead of both (see MappedFile). Like
+// BatchRing in pipeline.h, the ring gives backpressure: the thread waits if it
+// gets kSlots chunks ahead, so memory use stays bounded.
+//
+// Unlike BatchRing, this uses a mutex and condition variable instead of
+// atomics. A chunk is large, so the queue is touched rarely and its speed
+// doesn't matter; and the consumer may stop early (when it's destroyed), which
+// a condition variable makes easy to handle.
+class Decompressor {
+ public:
+  // compression must be supported (see compression_supported()).
+  Decompressor(MappedFile file, Compression compression);
+  // Stops the thread, even if it isn't finished.
+  ~Decompressor();
+  Decompressor(const Decompressor&) = delete;
+  Decompressor& operator=(const Decompressor&) = delete;
+
+  // Appends the next chunk of decompressed bytes to *out, waiting for it if
+  // necessary. Returns false, appending nothing, at the end of the data.
+  bool read_chunk(std::vector<char>* out);
+
+  // True if the input turned out to be corrupt or truncated. Only meaningful
+  // after read_chunk() has returned false.
+  bool failed() const;
+
+  // How many bytes of the compressed file the chunks returned by read_chunk()
+  // so far were decompressed from. Once read_chunk() returns false, that's
+  // the whole file (unless it's corrupt).
+  size_t input_bytes() const { return input_bytes_; }
+
+ private:
+  static constexpr size_t kChunkSize = 1 << 20;
+  static constexpr size_t kSlots = 4;
+
+  MappedFile file_;
+  Compression compression_;
+
+  // The ring: chunk i is in slots_[i % kSlots], with sizes_[i % kSlots]
+  // bytes, decompressed from the file up to offset ends_[i % kSlots]. head_
+  // counts chunks written, tail_ chunks read. done_ means the thread has
+  // written its last chunk; stop_ asks it to quit early.
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::vector<char>> slots_;
+  std::vector<size_t> sizes_;
+  std::vector<size_t> ends_;
+  size_t head_;
+  size_t tail_;
+  bool done_;
+  bool stop_;
+  bool failed_;
+  // Only used by the caller's thread, in read_chunk().
+  size_t input_bytes_;
+
+  // Declared last, so it starts after everything above is initialized.
+  std::thread thread_;
+
+  // The thread's side of the ring. begin_write() waits for a free slot and
+  // returns it, or returns nullptr if we've been told to stop.
+  // end_write(n, end) publishes the first n bytes of it, decompressed from
+  // the file up to offset end; finish() marks the end of the data.
+  char* begin_write();
+  void end_write(size_t n, size_t end);
+  void finish(bool ok);
+
+  // The thread's main function, for each format. They return false if the
+  // input is corrupt.
+  void run();
+  bool run_gzip();
+  bool run_zstd();
+};
+
+#endif  // DECOMPRESS_H
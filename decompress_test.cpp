@@ -0,0 +1,208 @@
+// Checks Decompressor on gzip and (if this build has libzstd) zstd input, and
+// times it. Run it with `make check`.
+//
+// The test compresses some data.txt-style text itself, writes it to a
+// temporary file (Decompressor reads a MappedFile), and decompresses it again.
+// Besides plain files, it covers the cases that are easy to get wrong:
+// several streams one after another (`cat a.gz b.gz`, which is still a valid
+// file), output that ends exactly at a chunk boundary, and input that is
+// truncated or has garbage after it, which must be reported with failed().
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+#ifdef STATS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "decompress.h"
+#include "mapped_file.h"
+
+namespace {
+
+const char* const kTempPath = "decompress_test.tmp";
+
+int failures = 0;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+std::string gzip(const std::string& text) {
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  // 15 + 16 asks for a gzip header rather than a zlib one.
+  deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+               Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(&zs, text.size()), '\0');
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+  zs.avail_in = text.size();
+  zs.next_out = reinterpret_cast<Bytef*>(out.data());
+  zs.avail_out = out.size();
+  deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return out;
+}
+
+#ifdef STATS_HAVE_ZSTD
+std::string zstd(const std::string& text) {
+  std::string out(ZSTD_compressBound(text.size()), '\0');
+  out.resize(ZSTD_compress(out.data(), out.size(), text.data(), text.size(),
+                           3));
+  return out;
+}
+#endif
+
+// Decompresses bytes with a Decompressor, as CompressedDataSource does.
+// Returns the output, and sets *failed to failed() and, if it isn't null,
+// *input_bytes to input_bytes().
+std::string decompress(const std::string& bytes, bool* failed,
+                       size_t* input_bytes = nullptr) {
+  std::FILE* file = std::fopen(kTempPath, "wb");
+  std::fwrite(bytes.data(), 1, bytes.size(), file);
+  std::fclose(file);
+  MappedFile mapped;
+  if (!mapped.open(kTempPath)) {
+    std::cerr << "Can't open " << kTempPath << '\n';
+    *failed = true;
+    return "";
+  }
+  Compression compression = detect_compression(mapped);
+  Decompressor decompressor(std::move(mapped), compression);
+  std::vector<char> out;
+  while (decompressor.read_chunk(&out)) {
+  }
+  *failed = decompressor.failed();
+  if (input_bytes != nullptr) {
+    *input_bytes = decompressor.input_bytes();
+  }
+  return std::string(out.begin(), out.end());
+}
+
+// Values like data.txt's, one per line, until there are at least size bytes.
+std::string make_text(size_t size, std::mt19937_64* rng) {
+  std::normal_distribution<double> normal(0.0, 1.0);
+  std::string text;
+  char buf[32];
+  while (text.size() < size) {
+    text.append(buf, std::snprintf(buf, sizeof(buf), "%.17g\n", normal(*rng)));
+  }
+  return text;
+}
+
+void check_ok(const char* format, const char* what, const std::string& bytes,
+              const std::string& expected) {
+  bool failed;
+  size_t input_bytes;
+  std::string actual = decompress(bytes, &failed, &input_bytes);
+  if (failed || actual != expected) {
+    fail(std::string(format) + ": wrong result for " + what);
+  }
+  // All of the input was used, including for the last chunk.
+  if (input_bytes != bytes.size()) {
+    fail(std::string(format) + ": input_bytes() is " +
+         std::to_string(input_bytes) + " instead of " +
+         std::to_string(bytes.size()) + " for " + what);
+  }
+}
+
+// Input that is corrupt somewhere after expected_prefix: the output must stop
+// no later than that (it can't be trusted beyond it) and failed() must say so.
+void check_fails(const char* format, const char* what,
+                 const std::string& bytes, const std::string& expected_prefix) {
+  bool failed;
+  std::string actual = decompress(bytes, &failed);
+  if (!failed) {
+    fail(std::string(format) + ": " + what + " isn't reported");
+  }
+  if (actual.size() > expected_prefix.size() ||
+      expected_prefix.compare(0, actual.size(), actual) != 0) {
+    fail(std::string(format) + ": wrong output for " + what);
+  }
+}
+
+template <typename Compress>
+void check(const char* format, Compress compress, std::mt19937_64* rng) {
+  // a spans several chunks; b is exactly two, so a chunk ends where it does.
+  std::string a = make_text(3 << 20, rng);
+  std::string b(2 << 20, '\n');
+  std::string a_bytes = compress(a);
+  std::string b_bytes = compress(b);
+  std::string empty_bytes = compress("");
+
+  check_ok(format, "a file", a_bytes, a);
+  check_ok(format, "a file of whole chunks", b_bytes, b);
+  check_ok(format, "concatenated files", a_bytes + b_bytes + a_bytes,
+           a + b + a);
+  check_ok(format, "an empty file in the middle",
+           b_bytes + empty_bytes + a_bytes, b + a);
+
+  check_fails(format, "a file cut in half",
+              a_bytes.substr(0, a_bytes.size() / 2), a);
+  check_fails(format, "a missing last byte",
+              a_bytes.substr(0, a_bytes.size() - 1), a);
+  check_fails(format, "a second file cut short",
+              a_bytes + b_bytes.substr(0, 20), a + b);
+  check_fails(format, "garbage at the end", a_bytes + "garbage", a);
+
+  // Stopping early, as when the reader is destroyed before the end, mustn't
+  // hang.
+  {
+    MappedFile mapped;
+    std::string big = a_bytes + a_bytes + a_bytes;
+    std::FILE* file = std::fopen(kTempPath, "wb");
+    std::fwrite(big.data(), 1, big.size(), file);
+    std::fclose(file);
+    mapped.open(kTempPath);
+    Compression compression = detect_compression(mapped);
+    Decompressor decompressor(std::move(mapped), compression);
+    std::vector<char> out;
+    decompressor.read_chunk(&out);
+  }
+
+  // Time decompressing a on its own, the fastest of a few runs.
+  double best = HUGE_VAL;
+  for (int run = 0; run < 3; run++) {
+    auto start = std::chrono::steady_clock::now();
+    bool failed;
+    decompress(a_bytes, &failed);
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, time.count());
+  }
+  std::printf("%-5s %6.1f MB/s decompressed (ratio %.2f)\n", format,
+              a.size() / best / 1e6,
+              static_cast<double>(a.size()) / a_bytes.size());
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  check("gzip", gzip, &rng);
+#ifdef STATS_HAVE_ZSTD
+  check("zstd", zstd, &rng);
+#else
+  std::cout << "decompress: zstd isn't supported by this build; skipped\n";
+#endif
+  std::remove(kTempPath);
+
+  if (failures > 0) {
+    std::cerr << "decompress: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "decompress: all checks passed\n";
+  return 0;
+}
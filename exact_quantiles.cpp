@@ -0,0 +1,295 @@
+#include "exact_quantiles.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "parallel.h"
+
+namespace {
+
+// Ranges smaller than this are left to std::nth_element on one thread. At 1M
+// doubles (8 MB), starting the threads for another parallel pass costs more
+// than it saves. Above it, we use our own passes even with one thread, since
+// they need fewer of them than std::nth_element does (see select()).
+constexpr size_t kParallelCutoff = 1 << 20;
+
+// Number of values in the sample we pick pivots from, and how far past the
+// wanted rank (as a fraction of the range) we aim the pivot. The sample's
+// quantiles are off by at most sqrt(1/4 / kSampleSize) = 0.016 in rank
+// (one standard deviation), so aiming 0.05 past the rank puts the rank on the
+// side we expect nearly every time.
+constexpr size_t kSampleSize = 1024;
+constexpr double kPivotMargin = 0.05;
+
+// A list of index ranges [first, second), walked one index at a time. Used by
+// parallel_partition() to pair up values on the wrong side.
+using Ranges = std::vector<std::pair<size_t, size_t>>;
+
+class RangeCursor {
+ public:
+  // Starts at the skip-th index in ranges.
+  RangeCursor(const Ranges& ranges, size_t skip) : ranges_(ranges), range_(0) {
+    while (skip >= ranges_[range_].second - ranges_[range_].first) {
+      skip -= ranges_[range_].second - ranges_[range_].first;
+      range_++;
+    }
+    pos_ = ranges_[range_].first + skip;
+  }
+
+  // Returns the current index and moves to the next one.
+  size_t next() {
+    size_t result = pos_++;
+    if (pos_ == ranges_[range_].second && range_ + 1 < ranges_.size()) {
+      range_++;
+      pos_ = ranges_[range_].first;
+    }
+    return result;
+  }
+
+ private:
+  const Ranges& ranges_;
+  size_t range_;
+  size_t pos_;
+};
+
+// Like std::partition(begin, end, pred), but several times faster on random
+// data. std::partition branches on pred for every value, and when pred is
+// true about half the time, the CPU mispredicts half of those branches.
+//
+// This is the block partition from "BlockQuicksort: How Branch Mispredictions
+// don't affect Quicksort" by Edelkamp and Weiss:
+//
+//     https://arxiv.org/abs/1604.06697
+//
+// We look at a block of kBlockSize values at each end, and record the offsets
+// of the values on the wrong side (false on the left, true on the right)
+// without branching: every offset is written, but the count only advances for
+// the wrong ones. Then we swap pairs of wrong values. The only branches left
+// are the loop conditions, which are predictable.
+constexpr size_t kBlockSize = 128;
+
+template <typename Pred>
+double* block_partition(double* begin, double* end, const Pred& pred) {
+  unsigned char left_offsets[kBlockSize];
+  unsigned char right_offsets[kBlockSize];
+  size_t left_count = 0;
+  size_t right_count = 0;
+  size_t left_start = 0;
+  size_t right_start = 0;
+  while (end - begin > static_cast<ptrdiff_t>(2 * kBlockSize)) {
+    if (left_count == 0) {
+      left_start = 0;
+      for (size_t i = 0; i < kBlockSize; i++) {
+        left_offsets[left_count] = i;
+        left_count += !pred(begin[i]);
+      }
+    }
+    if (right_count == 0) {
+      right_start = 0;
+      for (size_t i = 0; i < kBlockSize; i++) {
+        right_offsets[right_count] = i;
+        right_count += pred(end[-1 - static_cast<ptrdiff_t>(i)]);
+      }
+    }
+    size_t swaps = std::min(left_count, right_count);
+    for (size_t i = 0; i < swaps; i++) {
+      std::swap(begin[left_offsets[left_start + i]],
+                end[-1 - right_offsets[right_start + i]]);
+    }
+    left_count -= swaps;
+    right_count -= swaps;
+    left_start += swaps;
+    right_start += swaps;
+    // A block with no wrong values left is done.
+    if (left_count == 0) {
+      begin += kBlockSize;
+    }
+    if (right_count == 0) {
+      end -= kBlockSize;
+    }
+  }
+  // Everything before begin is true and everything after end is false, so
+  // partitioning the rest finishes the job.
+  return std::partition(begin, end, pred);
+}
+
+// Like std::partition(data.begin(), data.end(), pred), using several threads:
+// moves the values where pred is true to the front, and returns how many
+// there are.
+//
+// First each thread partitions its own chunk of data. Then every chunk looks
+// like [true... | false...], and the number of true values is the sum of the
+// counts, L. The values that are still on the wrong side are the false ones in
+// [0, L) and the true ones in [L, n); there are exactly as many of each. We
+// list both as ranges (at most one per chunk), and swap the i-th wrong value
+// on the left with the i-th wrong value on the right, with each thread taking
+// an equal share of the swaps.
+template <typename Pred>
+size_t parallel_partition(std::span<double> data, const Pred& pred,
+                          size_t threads) {
+  size_t n = data.size();
+  std::vector<size_t> splits(threads);
+  parallel_for(threads, [&](size_t t) {
+    double* begin = data.data() + n * t / threads;
+    double* end = data.data() + n * (t + 1) / threads;
+    splits[t] = block_partition(begin, end, pred) - data.data();
+  });
+
+  size_t left_count = 0;
+  for (size_t t = 0; t < threads; t++) {
+    left_count += splits[t] - n * t / threads;
+  }
+  Ranges wrong_left;
+  Ranges wrong_right;
+  size_t misplaced = 0;
+  for (size_t t = 0; t < threads; t++) {
+    size_t begin = n * t / threads;
+    size_t end = n * (t + 1) / threads;
+    // False values, [splits[t], end), that fall before left_count.
+    size_t false_end = std::min(end, left_count);
+    if (splits[t] < false_end) {
+      wrong_left.emplace_back(splits[t], false_end);
+      misplaced += false_end - splits[t];
+    }
+    // True values, [begin, splits[t]), that fall at or after left_count.
+    size_t true_begin = std::max(begin, left_count);
+    if (true_begin < splits[t]) {
+      wrong_right.emplace_back(true_begin, splits[t]);
+    }
+  }
+  if (misplaced == 0) {
+    return left_count;
+  }
+  parallel_for(threads, [&](size_t t) {
+    size_t first = misplaced * t / threads;
+    size_t last = misplaced * (t + 1) / threads;
+    if (first == last) {
+      return;
+    }
+    RangeCursor left(wrong_left, first);
+    RangeCursor right(wrong_right, first);
+    for (size_t i = first; i < last; i++) {
+      std::swap(data[left.next()], data[right.next()]);
+    }
+  });
+  return left_count;
+}
+
+// Picks a pivot for finding the value of rank `target` (an index into data),
+// from an evenly spaced sample of data. Aims a little past the target, away
+// from the middle, so that after partitioning, the target is in the smaller
+// side and close to its far end; the next pass then cuts that side down to a
+// sliver.
+double pick_pivot(std::span<const double> data, size_t target) {
+  size_t n = data.size();
+  std::vector<double> sample(kSampleSize);
+  for (size_t i = 0; i < kSampleSize; i++) {
+    sample[i] = data[n / kSampleSize * i];
+  }
+  double f = double(target) / n;
+  f = f < 0.5 ? f + kPivotMargin : f - kPivotMargin;
+  size_t k = std::clamp<size_t>(f * kSampleSize, 0, kSampleSize - 1);
+  std::nth_element(sample.begin(), sample.begin() + k, sample.end());
+  return sample[k];
+}
+
+// Puts the value of each rank in ranks at that index of data, like
+// std::nth_element for each one, looking only at data[begin, end). The ranks
+// are sorted, and all within [begin, end).
+//
+// passes is how many more partitioning passes of our own we may make. A
+// sampled pivot is nearly always good, but input built to defeat the sample
+// could make every pass split off only a few values, taking O(n^2) time. So,
+// as in introselect, once the budget runs out we leave the rest to
+// std::nth_element, which has its own fallback and is never worse than
+// O(n log n).
+void select(std::span<double> data, size_t begin, size_t end,
+            std::span<const size_t> ranks, size_t threads, size_t passes) {
+  if (ranks.empty()) {
+    return;
+  }
+  if (end - begin < kParallelCutoff || passes == 0) {
+    // Find the middle rank, then the ranks on either side of it, each within
+    // its own side.
+    size_t middle = ranks.size() / 2;
+    size_t k = ranks[middle];
+    std::nth_element(data.begin() + begin, data.begin() + k,
+                     data.begin() + end);
+    select(data, begin, k, ranks.first(middle), threads, 0);
+    select(data, k + 1, end, ranks.subspan(middle + 1), threads, 0);
+    return;
+  }
+
+  // With one rank, aim the pivot past it (see pick_pivot()). With several,
+  // split them at the middle one.
+  std::span<double> range = data.subspan(begin, end - begin);
+  size_t target = ranks.size() == 1 ? ranks[0] : ranks[ranks.size() / 2];
+  double pivot = pick_pivot(range, target - begin);
+  size_t split = begin + parallel_partition(
+                             range, [pivot](double x) { return x < pivot; },
+                             threads);
+  size_t left = std::lower_bound(ranks.begin(), ranks.end(), split) -
+                ranks.begin();
+  if (split == begin) {
+    // The pivot is the smallest value, so nothing moved. Split off the values
+    // equal to it instead: they're already in their sorted places, so any
+    // ranks among them are done. (The pivot comes from the data, so there's
+    // at least one.)
+    split = begin + parallel_partition(
+                        range, [pivot](double x) { return x <= pivot; },
+                        threads);
+    left = std::lower_bound(ranks.begin(), ranks.end(), split) -
+           ranks.begin();
+  } else {
+    select(data, begin, split, ranks.first(left), threads, passes - 1);
+  }
+  select(data, split, end, ranks.subspan(left), threads, passes - 1);
+}
+
+}  // namespace
+
+std::vector<double> exact_quantiles(std::span<double> data,
+                                    std::span<const double> qs,
+                                    size_t threads) {
+  if (threads < 1) {
+    threads = 1;
+  }
+  // NaN isn't less than, greater than or equal to anything, which would break
+  // the partitions, so move it out of the way first.
+  size_t n = parallel_partition(
+      data, [](double x) { return !std::isnan(x); }, threads);
+  data = data.first(n);
+  if (n == 0) {
+    return std::vector<double>(qs.size(),
+                               std::numeric_limits<double>::quiet_NaN());
+  }
+
+  // Each quantile needs the values at floor(h) and floor(h) + 1.
+  std::vector<size_t> ranks;
+  for (double q : qs) {
+    double h = std::clamp(q, 0.0, 1.0) * (n - 1);
+    size_t k = static_cast<size_t>(h);
+    ranks.push_back(k);
+    if (k + 1 < n) {
+      ranks.push_back(k + 1);
+    }
+  }
+  std::sort(ranks.begin(), ranks.end());
+  ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+  // Good pivots need two or three passes per rank (see exact_quantiles.h),
+  // and even pivots that only split the range in half would need fewer than
+  // bit_width(n). Twice that leaves plenty of room for unlucky samples.
+  select(data, 0, n, ranks, threads, 2 * std::bit_width(n));
+
+  std::vector<double> result;
+  for (double q : qs) {
+    double h = std::clamp(q, 0.0, 1.0) * (n - 1);
+    size_t k = static_cast<size_t>(h);
+    double t = h - k;
+    result.push_back(t == 0 ? data[k] : data[k] + t * (data[k + 1] - data[k]));
+  }
+  return result;
+}
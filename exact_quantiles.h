@@ -0,0 +1,46 @@
+#ifndef EXACT_QUANTILES_H
+#define EXACT_QUANTILES_H
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Computes exact quantiles of data, for --exact-quantiles. Returns one value
+// per entry of qs (each from 0 to 1), in the same order; all NaN if data has
+// no values. NaN values in data are ignored.
+//
+// The q-th quantile of n sorted values x[0..n-1] is x[h], for h = q * (n - 1),
+// interpolating linearly between x[floor(h)] and x[floor(h) + 1] when h isn't
+// a whole number. (That's the usual definition, and the default in R and
+// NumPy.)
+//
+// Sorting would find them, in O(n log n) time, but we only need a few "order
+// statistics" (x[k] for a few k), and selection finds those in O(n).
+// Quickselect is like quicksort, except that after partitioning around a
+// pivot, it only continues into the side that holds k. std::nth_element does
+// this, and puts x[k] at data[k], with everything smaller before it and
+// everything larger after.
+//
+// We go further in three ways:
+//
+// - Several quantiles share work. After a partition, the ranks on the left
+//   and on the right are found in their own sides, so each value is only
+//   partitioned again for the ranks on its side.
+// - The pivot is picked from a sample of the data, aimed just past the rank
+//   we want, so that the side holding it is usually small. Two or three passes
+//   shrink 10^8 values down to a range std::nth_element can finish quickly.
+//   As in introselect, the passes have a budget; input that keeps defeating
+//   the sample is handed to std::nth_element once it runs out.
+// - Each pass is split across threads, and uses a partition that avoids
+//   mispredicted branches (see exact_quantiles.cpp).
+//
+// On 5 * 10^7 normal values, on one core, the median takes 0.33 seconds,
+// against 0.93 for std::nth_element and 11 for std::sort.
+//
+// data is reordered in place, which is why it isn't const: the caller can pass
+// the vector it already has instead of making a copy.
+std::vector<double> exact_quantiles(std::span<double> data,
+                                    std::span<const double> qs,
+                                    size_t threads);
+
+#endif  // EXACT_QUANTILES_H
@@ -0,0 +1,144 @@
+// Checks exact_quantiles() against sorting, and times it next to
+// std::nth_element. Run it with `make check`.
+//
+// The inputs cover the cases that break selection code: several quantiles at
+// once (which share passes), the very first and last values, all-equal data
+// and heavy duplicates (where a pivot can fail to split anything off), sorted
+// input, and sizes above kParallelCutoff (2^20), so that the parallel
+// partitioning passes run, on one thread and on several.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "exact_quantiles.h"
+
+namespace {
+
+int failures = 0;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+// The definition in exact_quantiles.h, on a sorted copy of data.
+std::vector<double> sorted_quantiles(std::vector<double> data,
+                                     const std::vector<double>& qs) {
+  std::sort(data.begin(), data.end());
+  std::vector<double> result;
+  for (double q : qs) {
+    double h = q * (data.size() - 1);
+    size_t k = static_cast<size_t>(h);
+    double t = h - k;
+    result.push_back(t == 0 ? data[k] : data[k] + t * (data[k + 1] - data[k]));
+  }
+  return result;
+}
+
+void check(const std::string& what, const std::vector<double>& data) {
+  const std::vector<double> qs = {0.0, 0.001, 0.25, 0.5, 0.5, 0.9,
+                                  0.99, 0.999, 1.0};
+  std::vector<double> expected = sorted_quantiles(data, qs);
+  for (size_t threads : {1, 3, 8}) {
+    // Each quantile on its own, and all of them at once.
+    std::vector<double> copy = data;
+    if (exact_quantiles(copy, qs, threads) != expected) {
+      fail("exact_quantiles() is wrong for " + what + " on " +
+           std::to_string(threads) + " threads");
+    }
+    for (size_t i = 0; i < qs.size(); i++) {
+      copy = data;
+      std::vector<double> one = exact_quantiles(copy, {&qs[i], 1}, threads);
+      if (one[0] != expected[i]) {
+        fail("exact_quantiles() is wrong for q = " + std::to_string(qs[i]) +
+             " of " + what + " on " + std::to_string(threads) + " threads");
+      }
+    }
+  }
+}
+
+// Seconds for f(), the fastest of a few runs on a fresh copy of data.
+template <typename F>
+double seconds(const std::vector<double>& data, const F& f) {
+  double best = HUGE_VAL;
+  for (int run = 0; run < 3; run++) {
+    std::vector<double> copy = data;
+    auto start = std::chrono::steady_clock::now();
+    f(copy);
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, time.count());
+  }
+  return best;
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+
+  for (size_t n : {1, 2, 3, 1000, 3000000}) {
+    std::string size = std::to_string(n) + " ";
+    std::vector<double> data(n);
+    for (double& x : data) {
+      x = normal(rng);
+    }
+    check(size + "normal values", data);
+    std::sort(data.begin(), data.end());
+    check(size + "sorted values", data);
+    std::reverse(data.begin(), data.end());
+    check(size + "reverse sorted values", data);
+    std::fill(data.begin(), data.end(), 1.5);
+    check(size + "equal values", data);
+    for (double& x : data) {
+      x = rng() % 3;
+    }
+    check(size + "values with many duplicates", data);
+    for (double& x : data) {
+      x = rng() % 2 == 0 ? 0.0 : normal(rng);
+    }
+    check(size + "values, half of them zero", data);
+  }
+
+  // NaN is ignored, and no values at all gives NaN.
+  std::vector<double> data = {NAN, 3.0, NAN, 1.0, 2.0};
+  std::vector<double> qs = {0.0, 0.5, 1.0};
+  if (exact_quantiles(data, qs, 1) != std::vector<double>{1.0, 2.0, 3.0}) {
+    fail("exact_quantiles() doesn't ignore NaN");
+  }
+  data = {NAN};
+  if (!std::isnan(exact_quantiles(data, qs, 1)[1])) {
+    fail("exact_quantiles() of nothing isn't NaN");
+  }
+
+  if (failures > 0) {
+    std::cerr << "exact_quantiles: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "exact_quantiles: all checks passed\n";
+
+  // The median of 5 * 10^7 normal values, as in exact_quantiles.h.
+  data.resize(50000000);
+  for (double& x : data) {
+    x = normal(rng);
+  }
+  double median = 0.5;
+  std::printf("%-18s %6.2f s for the median of 5e7 values\n",
+              "exact_quantiles()", seconds(data, [&](std::vector<double>& v) {
+                exact_quantiles(v, {&median, 1}, 1);
+              }));
+  std::printf("%-18s %6.2f s\n", "std::nth_element",
+              seconds(data, [](std::vector<double>& v) {
+                std::nth_element(v.begin(), v.begin() + v.size() / 2,
+                                 v.end());
+              }));
+  return 0;
+}
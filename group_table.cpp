@@ -0,0 +1,115 @@
+#include "group_table.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kInitialSlots = 64;
+constexpr size_t kArenaBlockSize = 64 * 1024;
+
+// A fast, good-enough hash for short keys: mix in 8 bytes at a time with a
+// multiply, xor and shift, then scramble the result so every bit of the key
+// affects the low bits we use to pick a slot. (The constants are from
+// splitmix64.)
+uint64_t hash_key(std::string_view key) {
+  const char* p = key.data();
+  size_t n = key.size();
+  uint64_t h = 0x9e3779b97f4a7c15ull ^ n;
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    h = (h ^ word) * 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 31;
+  }
+  uint64_t word = 0;
+  if (n > 0) {
+    std::memcpy(&word, p, n);
+  }
+  h = (h ^ word) * 0x94d049bb133111ebull;
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 32;
+  return h;
+}
+
+}  // namespace
+
+GroupTable::GroupTable()
+    : slots_(kInitialSlots, Slot{0, 0}), arena_pos_(nullptr), arena_left_(0) {}
+
+RunningStats& GroupTable::find_or_add(std::string_view key) {
+  uint64_t hash = hash_key(key);
+  size_t mask = slots_.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    Slot& slot = slots_[i];
+    if (slot.entry == 0) {
+      // Not found, so add it here. Keep the table at most 3/4 full: the
+      // fuller it gets, the longer the runs of occupied slots we probe.
+      if ((keys_.size() + 1) * 4 > slots_.size() * 3) {
+        grow();
+        return find_or_add(key);
+      }
+      keys_.push_back(intern(key));
+      stats_.emplace_back();
+      slot = Slot{hash, keys_.size()};
+      return stats_.back();
+    }
+    if (slot.hash == hash && keys_[slot.entry - 1] == key) {
+      return stats_[slot.entry - 1];
+    }
+  }
+}
+
+void GroupTable::merge(const GroupTable& other) {
+  for (size_t i = 0; i < other.keys_.size(); i++) {
+    find_or_add(other.keys_[i]).merge(other.stats_[i]);
+  }
+}
+
+std::vector<std::pair<std::string_view, const RunningStats*>>
+GroupTable::sorted() const {
+  std::vector<std::pair<std::string_view, const RunningStats*>> result;
+  result.reserve(keys_.size());
+  for (size_t i = 0; i < keys_.size(); i++) {
+    result.emplace_back(keys_[i], &stats_[i]);
+  }
+  std::sort(result.begin(), result.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+  return result;
+}
+
+std::string_view GroupTable::intern(std::string_view key) {
+  if (key.empty()) {
+    return std::string_view();
+  }
+  if (key.size() > arena_left_) {
+    // Start a new block. An unusually long key gets a block of its own.
+    size_t size = std::max(kArenaBlockSize, key.size());
+    arena_.push_back(std::make_unique_for_overwrite<char[]>(size));
+    arena_pos_ = arena_.back().get();
+    arena_left_ = size;
+  }
+  char* copy = arena_pos_;
+  std::memcpy(copy, key.data(), key.size());
+  arena_pos_ += key.size();
+  arena_left_ -= key.size();
+  return std::string_view(copy, key.size());
+}
+
+void GroupTable::grow() {
+  std::vector<Slot> old = std::move(slots_);
+  slots_.assign(old.size() * 2, Slot{0, 0});
+  size_t mask = slots_.size() - 1;
+  // We kept each key's hash, so there's no need to hash the keys again.
+  for (const Slot& slot : old) {
+    if (slot.entry == 0) {
+      continue;
+    }
+    size_t i = slot.hash & mask;
+    while (slots_[i].entry != 0) {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = slot;
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef GROUP_TABLE_H
+#define GROUP_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "running_stats.h"
+
+// A hash table from string keys to RunningStats, for --group-by.
+//
+// std::unordered_map<std::string, RunningStats> would work, but it costs a
+// std::string (often a heap allocation) for every lookup, and a separately
+// allocated node for every key, which scatters the table across memory. This
+// table avoids both:
+//
+// - Lookups take a std::string_view, which can point straight into the
+//   memory-mapped file, so looking up a key that's already there allocates
+//   nothing.
+// - Each new key is copied once into an arena: a few large blocks of memory
+//   that hold all the keys back to back ("interning"). The table itself is a
+//   flat array of small slots, searched with open addressing: if a key's slot
+//   is taken by another key, we try the next slot, and the next ("linear
+//   probing"). Neighboring slots share cache lines, so a probe is cheap.
+//
+// Each slot stores the key's full hash as well, so we only compare the key
+// bytes when the hashes match.
+class GroupTable {
+ public:
+  GroupTable();
+  GroupTable(const GroupTable&) = delete;
+  GroupTable& operator=(const GroupTable&) = delete;
+  GroupTable(GroupTable&&) = default;
+  GroupTable& operator=(GroupTable&&) = default;
+
+  // Returns the statistics for key, adding an empty entry if key is new. The
+  // reference is only valid until the next call, which may grow the table.
+  RunningStats& find_or_add(std::string_view key);
+
+  // Merges the statistics of every key in other into this table.
+  void merge(const GroupTable& other);
+
+  // Number of distinct keys.
+  size_t size() const { return keys_.size(); }
+
+  // Every key and its statistics, sorted by key.
+  std::vector<std::pair<std::string_view, const RunningStats*>> sorted() const;
+
+ private:
+  struct Slot {
+    uint64_t hash;
+    // 1 + the index of the key in keys_ and stats_, or 0 for an empty slot.
+    size_t entry;
+  };
+
+  // A power of two, so hash & (slots_.size() - 1) picks a slot.
+  std::vector<Slot> slots_;
+  // Keys and statistics, in the order the keys were added. The keys point
+  // into arena_.
+  std::vector<std::string_view> keys_;
+  std::vector<RunningStats> stats_;
+
+  // Arena blocks, and the unused part of the last one.
+  std::vector<std::unique_ptr<char[]>> arena_;
+  char* arena_pos_;
+  size_t arena_left_;
+
+  // Copies key into the arena.
+  std::string_view intern(std::string_view key);
+  // Doubles the number of slots.
+  void grow();
+};
+
+#endif  // GROUP_TABLE_H
@@ -0,0 +1,148 @@
+// Checks GroupTable against std::unordered_map<std::string, RunningStats>.
+// Run it with `make check`.
+//
+// The keys are chosen to exercise the parts of the table that are easy to get
+// wrong: enough of them that the table grows (and rehashes) many times, keys
+// that only differ after their first 8 bytes (the first word hash_key()
+// mixes in), the empty key, keys longer than an arena block, and keys whose
+// original text is overwritten after the lookup, which only works if the
+// table keeps its own copy. Per-thread tables are merged as CsvGroupReader
+// merges them.
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "group_table.h"
+#include "running_stats.h"
+
+namespace {
+
+using Reference = std::unordered_map<std::string, RunningStats>;
+
+int failures = 0;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+bool same_stats(const RunningStats& a, const RunningStats& b) {
+  return a.count() == b.count() && a.mean() == b.mean() &&
+         a.variance() == b.variance();
+}
+
+// Whether table has exactly the keys and statistics of reference.
+void compare(const std::string& what, const GroupTable& table,
+             const Reference& reference) {
+  if (table.size() != reference.size()) {
+    fail(what + ": " + std::to_string(table.size()) + " keys instead of " +
+         std::to_string(reference.size()));
+    return;
+  }
+  auto sorted = table.sorted();
+  for (size_t i = 0; i < sorted.size(); i++) {
+    const auto& [key, stats] = sorted[i];
+    if (i > 0 && !(sorted[i - 1].first < key)) {
+      fail(what + ": sorted() is out of order");
+    }
+    auto it = reference.find(std::string(key));
+    if (it == reference.end()) {
+      fail(what + ": unexpected key '" + std::string(key) + "'");
+    } else if (!same_stats(*stats, it->second)) {
+      fail(what + ": wrong statistics for key '" + std::string(key) + "'");
+    }
+  }
+}
+
+// The i-th key. Keys of the same form share a prefix (up to 38 bytes long),
+// so only the bytes after it, or the length, tell them apart.
+std::string make_key(size_t i) {
+  switch (i % 5) {
+    case 0:
+      return std::to_string(i);
+    case 1:
+      return "same 8 b" + std::to_string(i);
+    case 2:
+      return "a longer shared prefix, over 16 bytes/" + std::to_string(i);
+    case 3:
+      // Keys with every byte value, including '\0' and the high half.
+      return std::string("\0\xff", 2) + std::string(i % 13, char(i));
+    default:
+      return std::string(i % 40, 'x');
+  }
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+
+  // One table, against the reference. Over 10000 distinct keys, so the table
+  // grows from 64 slots to 32768. The key is built in a buffer that's
+  // overwritten after each lookup.
+  const size_t kKeys = 20000;
+  GroupTable table;
+  Reference reference;
+  std::string key;
+  for (size_t n = 0; n < 200000; n++) {
+    // Half the lookups hit recent keys, half any key at all.
+    size_t i = rng() % 2 == 0 ? n % kKeys : rng() % kKeys;
+    key = make_key(i);
+    double x = normal(rng);
+    table.find_or_add(key).add(x);
+    reference[key].add(x);
+    key.assign(key.size(), '?');
+  }
+  // The empty key, and keys bigger than a 64 KB arena block, around a normal
+  // one.
+  for (std::string big : {std::string(), std::string(100000, 'b'),
+                          std::string("small"), std::string(70000, 'c')}) {
+    for (int n = 0; n < 3; n++) {
+      table.find_or_add(big).add(n);
+      reference[big].add(n);
+    }
+  }
+  compare("one table", table, reference);
+
+  // Per-thread tables, each with its own share of the values, merged in
+  // order. The reference merges the same per-thread statistics, so the
+  // results must match exactly.
+  const size_t kThreads = 4;
+  std::vector<GroupTable> tables(kThreads);
+  std::vector<Reference> references(kThreads);
+  for (size_t n = 0; n < 100000; n++) {
+    size_t t = n * kThreads / 100000;
+    // Some keys are in every table, some only in one.
+    size_t i = rng() % 2 == 0 ? rng() % 100 : 100 + rng() % 5000;
+    key = make_key(i);
+    double x = normal(rng);
+    tables[t].find_or_add(key).add(x);
+    references[t][key].add(x);
+  }
+  for (size_t t = 1; t < kThreads; t++) {
+    tables[0].merge(tables[t]);
+    for (const auto& [k, stats] : references[t]) {
+      references[0][k].merge(stats);
+    }
+  }
+  compare("merged tables", tables[0], references[0]);
+
+  // Merging an empty table, and into one, changes nothing.
+  GroupTable empty;
+  tables[0].merge(empty);
+  compare("a merged empty table", tables[0], references[0]);
+  empty.merge(tables[0]);
+  compare("a table merged into an empty one", empty, references[0]);
+
+  if (failures > 0) {
+    std::cerr << "group_table: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "group_table: all checks passed\n";
+  return 0;
+}
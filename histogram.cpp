@@ -0,0 +1,200 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Values per block in add(). The bucket numbers for a block take 1 KB.
+constexpr size_t kBlockSize = 256;
+
+// Log-linear buckets split each power of two into 2^kSubBits buckets, for
+// powers from 2^kMinExponent up to (but not including) 2^kMaxExponent.
+constexpr int kSubBits = 4;
+constexpr int kMinExponent = -64;
+constexpr int kMaxExponent = 64;
+
+// A double is stored as a sign bit, an 11-bit exponent (biased by 1023) and a
+// 52-bit fraction, and for positive values, the bits sort in the same order as
+// the values. So the exponent and the top kSubBits bits of the fraction,
+// taken together as an integer, number the log-linear buckets in order. We
+// call that the "magnitude index", and here are the ones where the range
+// starts and ends.
+constexpr int kFractionBits = 52;
+constexpr int kExponentBias = 1023;
+constexpr uint32_t kFirstIndex = uint32_t(kExponentBias + kMinExponent)
+                                 << kSubBits;
+constexpr uint32_t kEndIndex = uint32_t(kExponentBias + kMaxExponent)
+                               << kSubBits;
+// Buckets for each sign, inside the range.
+constexpr uint32_t kSignBuckets = kEndIndex - kFirstIndex;
+// The bucket for values near zero, with the negative buckets before it and
+// the positive ones after. Each side has kSignBuckets, plus one for values
+// beyond the range.
+constexpr uint32_t kZeroBucket = kSignBuckets + 1;
+constexpr uint32_t kLogLinearBuckets = 2 * kSignBuckets + 3;
+
+// Bucket numbers for linear buckets, written to out. 0 is for values below
+// low, 1 to bins for the bins, and bins + 1 for values at or above high. NaN
+// goes to bucket 0; add() fixes that up.
+//
+// The loop has no branches, so it vectorizes: each ?: becomes a SIMD compare
+// and blend. We clamp to [-1, bins] before converting to an integer, since
+// converting a number that doesn't fit (like infinity) is undefined, and
+// negative numbers all go to -1, since conversion rounds toward zero. NaN
+// fails every comparison, so it goes to -1 as well. (GCC is picky here:
+// written with std::max() and std::min(), the loop doesn't vectorize.)
+static_assert(Histogram::kMaxBins < INT32_MAX,
+              "linear_buckets() converts bin numbers to int32_t");
+void linear_buckets(const double* values, size_t n, double low, double scale,
+                    double bins, uint32_t* out) {
+  for (size_t i = 0; i < n; i++) {
+    double t = (values[i] - low) * scale;
+    t = t >= 0.0 ? t : -1.0;
+    t = t > bins ? bins : t;
+    out[i] = static_cast<int32_t>(t) + 1;
+  }
+}
+
+// Bucket numbers for log-linear buckets, written to out. NaN goes to one of
+// the outermost buckets. Vectorizes like linear_buckets().
+void log_linear_buckets(const double* values, size_t n, uint32_t* out) {
+  for (size_t i = 0; i < n; i++) {
+    uint64_t bits = std::bit_cast<uint64_t>(values[i]);
+    uint64_t index =
+        (bits & ~(uint64_t(1) << 63)) >> (kFractionBits - kSubBits);
+    // How far from zero: 0 below the range, 1 to kSignBuckets in it, and
+    // kSignBuckets + 1 above it.
+    uint64_t distance =
+        std::clamp<uint64_t>(index, kFirstIndex - 1, kEndIndex) -
+        (kFirstIndex - 1);
+    // Negate distance for negative values, without a branch: sign is all
+    // ones for negative values and 0 otherwise, and (d ^ -1) - (-1) == -d.
+    uint64_t sign = static_cast<int64_t>(bits) >> 63;
+    out[i] = kZeroBucket + ((distance ^ sign) - sign);
+  }
+}
+
+// Whether any of values is NaN. Testing for NaN in the loops above keeps them
+// from vectorizing, but this loop vectorizes on its own, and NaN is rare, so
+// add() checks with it and fixes the buckets of NaN only when there are any.
+bool has_nan(const double* values, size_t n) {
+  double nans = 0;
+  for (size_t i = 0; i < n; i++) {
+    nans += values[i] != values[i] ? 1.0 : 0.0;
+  }
+  return nans > 0;
+}
+
+// The lower end of the values at `distance` from zero (see
+// log_linear_buckets()), as a magnitude.
+double log_linear_magnitude(uint32_t distance) {
+  if (distance == 0) {
+    return 0.0;
+  }
+  if (distance > kSignBuckets + 1) {
+    return std::numeric_limits<double>::infinity();
+  }
+  uint32_t index = kFirstIndex + distance - 1;
+  int exponent = int(index >> kSubBits) - kExponentBias;
+  double fraction = 1.0 + double(index & ((1u << kSubBits) - 1)) /
+                              (1u << kSubBits);
+  return std::ldexp(fraction, exponent);
+}
+
+}  // namespace
+
+Histogram::Histogram()
+    : log_linear_(false), low_(0.0), high_(0.0), scale_(0.0), buckets_(0) {}
+
+Histogram::Histogram(double low, double high, size_t bins)
+    : log_linear_(false),
+      low_(low),
+      high_(high),
+      scale_(bins / (high - low)),
+      buckets_(bins + 2),
+      counts_((buckets_ + 1) * kCopies) {}
+
+Histogram Histogram::log_linear() {
+  Histogram histogram;
+  histogram.log_linear_ = true;
+  histogram.buckets_ = kLogLinearBuckets;
+  histogram.counts_.resize((histogram.buckets_ + 1) * kCopies);
+  return histogram;
+}
+
+void Histogram::add(std::span<const double> values) {
+  if (!enabled()) {
+    return;
+  }
+  uint32_t buckets[kBlockSize];
+  for (size_t start = 0; start < values.size(); start += kBlockSize) {
+    size_t n = std::min(kBlockSize, values.size() - start);
+    const double* block = values.data() + start;
+    if (log_linear_) {
+      log_linear_buckets(block, n, buckets);
+    } else {
+      linear_buckets(block, n, low_, scale_, buckets_ - 2, buckets);
+    }
+    if (has_nan(block, n)) {
+      for (size_t i = 0; i < n; i++) {
+        if (std::isnan(block[i])) {
+          buckets[i] = buckets_;
+        }
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      counts_[buckets[i] * kCopies + i % kCopies]++;
+    }
+  }
+}
+
+void Histogram::merge(const Histogram& other) {
+  for (size_t i = 0; i < counts_.size(); i++) {
+    counts_[i] += other.counts_[i];
+  }
+}
+
+uint64_t Histogram::count(size_t i) const {
+  uint64_t total = 0;
+  for (size_t copy = 0; copy < kCopies; copy++) {
+    total += counts_[i * kCopies + copy];
+  }
+  return total;
+}
+
+double Histogram::edge(size_t i) const {
+  if (log_linear_) {
+    // See log_linear_buckets() for the numbering.
+    return i <= kZeroBucket ? -log_linear_magnitude(kZeroBucket - i + 1)
+                            : log_linear_magnitude(i - kZeroBucket);
+  }
+  size_t bins = buckets_ - 2;
+  if (i == 0) {
+    return -std::numeric_limits<double>::infinity();
+  }
+  if (i > bins + 1) {
+    return std::numeric_limits<double>::infinity();
+  }
+  // The exact edge may not be a double, and add() computes buckets with a
+  // rounded scale_, so near an edge it may disagree with this formula by an
+  // ulp or two. Move to the first double that add() puts in bucket i or
+  // above, so the edges describe where values really go.
+  double edge = low_ + (high_ - low_) * (i - 1) / bins;
+  auto bucket = [&](double x) {
+    uint32_t b;
+    linear_buckets(&x, 1, low_, scale_, bins, &b);
+    return b;
+  };
+  constexpr double kInf = std::numeric_limits<double>::infinity();
+  while (bucket(edge) < i) {
+    edge = std::nextafter(edge, kInf);
+  }
+  while (bucket(std::nextafter(edge, -kInf)) >= i) {
+    edge = std::nextafter(edge, -kInf);
+  }
+  return edge;
+}
@@ -0,0 +1,91 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Counts how many values fall into each of a set of buckets, for --histogram.
+// There are two kinds of buckets:
+//
+// - Linear: `bins` buckets of equal width covering [low, high), plus one for
+//   values below low and one for values at or above high.
+// - Log-linear, like HdrHistogram (https://hdrhistogram.github.io/): every
+//   power of two, from 2^-64 to 2^64, is split into 16 equal buckets, for
+//   negative values as well as positive ones. Each bucket's width is at most
+//   1/16 of its values, so the buckets cover a huge range with about the same
+//   relative precision everywhere, without knowing the range in advance.
+//   Values closer to zero than 2^-64 share one bucket, and so do values
+//   beyond +-2^64 (and infinities) on each side.
+//
+// NaN values are counted separately, in both kinds.
+//
+// add() works a block at a time. First a loop with no branches computes the
+// bucket of every value in the block; the compiler turns it into SIMD code
+// (histogram.cpp is compiled with -O3; see the Makefile). Then a second loop
+// increments the counts. That part can't be done in SIMD, since two values in
+// the same register may hit the same bucket. It's one load and one store per
+// value, but when many values in a row hit the same bucket, each increment has
+// to wait for the one before it to reach memory. So we keep kCopies counts per
+// bucket, side by side in one cache line, and spread consecutive values
+// across them; count() adds them up. histogram_test times add() with all
+// values in one bucket and with values spread out.
+//
+// Like RunningStats, two histograms with the same buckets can be merge()d, by
+// adding up their counts, so each thread can fill its own.
+class Histogram {
+ public:
+  // The most linear bins we allow. Each bin takes kCopies counts, so this is
+  // 32 MB of them, already far more bins than anyone could read; and add()
+  // numbers the bins with 32-bit integers. That's per copy, and each thread
+  // fills its own, so main() limits how many threads share out the work.
+  static constexpr size_t kMaxBins = size_t(1) << 20;
+
+  // An empty histogram with no buckets, which ignores its input.
+  Histogram();
+  // Linear buckets. Requires low < high, with high - low finite, and
+  // 0 < bins <= kMaxBins.
+  Histogram(double low, double high, size_t bins);
+  // Log-linear buckets.
+  static Histogram log_linear();
+
+  // False for a histogram with no buckets.
+  bool enabled() const { return !counts_.empty(); }
+  bool is_log_linear() const { return log_linear_; }
+
+  void add(std::span<const double> values);
+
+  // Add other's counts to ours. Both must have the same buckets.
+  void merge(const Histogram& other);
+
+  // Number of buckets, in order of value, including the ones for values
+  // outside the range but not the NaN count.
+  size_t buckets() const { return buckets_; }
+  // The range [lower, upper) of values in bucket i. The outermost buckets go
+  // to -infinity and +infinity. For log-linear buckets of negative values, the
+  // range is really (lower, upper], and the middle bucket is (lower, upper).
+  double lower(size_t i) const { return edge(i); }
+  double upper(size_t i) const { return edge(i + 1); }
+  uint64_t count(size_t i) const;
+  uint64_t nan_count() const { return count(buckets_); }
+  // The bytes the counts take, in each copy of the histogram.
+  size_t bytes() const { return counts_.size() * sizeof(uint64_t); }
+
+ private:
+  bool log_linear_;
+  // For linear buckets.
+  double low_;
+  double high_;
+  // Buckets per unit, bins / (high - low).
+  double scale_;
+  size_t buckets_;
+  // kCopies counts per bucket, then kCopies for NaN.
+  static constexpr size_t kCopies = 4;
+  std::vector<uint64_t> counts_;
+
+  // The boundary between buckets i - 1 and i.
+  double edge(size_t i) const;
+};
+
+#endif  // HISTOGRAM_H
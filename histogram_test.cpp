@@ -0,0 +1,254 @@
+// Checks which bucket Histogram puts values in, especially values on or near
+// the edges, and times add(). Run it with `make check`.
+//
+// Every value must land in the bucket whose lower() and upper() contain it,
+// as histogram.h describes: [lower, upper), except for negative log-linear
+// buckets, which are (lower, upper]. Beyond the random values, that covers
+// the edges themselves, both zeros, subnormals, infinities and NaN.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+
+namespace {
+
+constexpr double kInf = std::numeric_limits<double>::infinity();
+
+int failures = 0;
+
+// time_add() stores results here, so the compiler can't skip the work.
+volatile uint64_t sink;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+std::string str(double x) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.17g", x);
+  return buf;
+}
+
+// The bucket that x goes in, or buckets() for the NaN count.
+size_t bucket_of(const Histogram& empty, double x) {
+  Histogram histogram = empty;
+  histogram.add({&x, 1});
+  for (size_t i = 0; i <= histogram.buckets(); i++) {
+    if (histogram.count(i) == 1) {
+      return i;
+    }
+  }
+  fail("Histogram lost " + str(x));
+  return 0;
+}
+
+// Whether bucket i of histogram is meant to hold x.
+bool contains(const Histogram& histogram, size_t i, double x) {
+  double lower = histogram.lower(i);
+  double upper = histogram.upper(i);
+  // The outermost buckets hold the infinities.
+  if (std::isinf(x)) {
+    return x == (x < 0 ? lower : upper);
+  }
+  if (histogram.is_log_linear() && lower < 0) {
+    // The middle bucket holds both zeros, and is open at both ends.
+    return upper > 0 ? lower < x && x < upper : lower < x && x <= upper;
+  }
+  return lower <= x && x < upper;
+}
+
+void check_value(const std::string& what, const Histogram& histogram,
+                 double x) {
+  size_t i = bucket_of(histogram, x);
+  if (std::isnan(x) ? i != histogram.buckets()
+                    : i == histogram.buckets() || !contains(histogram, i, x)) {
+    fail(what + ": " + str(x) + " is in bucket " + std::to_string(i) + ", [" +
+         str(histogram.lower(i)) + ", " + str(histogram.upper(i)) + ")");
+  }
+}
+
+// Checks that x lands in bucket `expected` (with the same lower edge, for
+// log-linear buckets, which are hard to number by hand).
+void check_lower(const std::string& what, const Histogram& histogram,
+                 double x, double expected_lower) {
+  check_value(what, histogram, x);
+  size_t i = bucket_of(histogram, x);
+  if (i >= histogram.buckets() || histogram.lower(i) != expected_lower) {
+    fail(what + ": " + str(x) + " isn't in the bucket starting at " +
+         str(expected_lower));
+  }
+}
+
+void check_upper(const std::string& what, const Histogram& histogram,
+                 double x, double expected_upper) {
+  check_value(what, histogram, x);
+  size_t i = bucket_of(histogram, x);
+  if (i >= histogram.buckets() || histogram.upper(i) != expected_upper) {
+    fail(what + ": " + str(x) + " isn't in the bucket ending at " +
+         str(expected_upper));
+  }
+}
+
+// Whether a and b have the same counts.
+bool same_counts(const Histogram& a, const Histogram& b) {
+  for (size_t i = 0; i <= a.buckets(); i++) {
+    if (a.count(i) != b.count(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void check_special_values(const std::string& what,
+                          const Histogram& histogram) {
+  double subnormal = std::numeric_limits<double>::denorm_min();
+  for (double x : {0.0, -0.0, subnormal, -subnormal, kInf, -kInf,
+                   std::numeric_limits<double>::quiet_NaN(),
+                   -std::numeric_limits<double>::quiet_NaN(),
+                   std::numeric_limits<double>::max(),
+                   std::numeric_limits<double>::lowest()}) {
+    check_value(what, histogram, x);
+  }
+}
+
+// Values spread over the whole range of doubles, and near the edges of the
+// histogram's buckets.
+void check_random_values(const std::string& what, const Histogram& histogram,
+                         std::mt19937_64* rng) {
+  std::uniform_real_distribution<double> exponent(-80.0, 80.0);
+  for (int n = 0; n < 20000; n++) {
+    double x = std::exp2(exponent(*rng));
+    check_value(what, histogram, (*rng)() % 2 == 0 ? x : -x);
+  }
+  for (size_t i = 1; i < histogram.buckets(); i += 1 + (*rng)() % 64) {
+    double edge = histogram.lower(i);
+    if (std::isfinite(edge)) {
+      check_value(what, histogram, edge);
+      check_value(what, histogram, std::nextafter(edge, -kInf));
+      check_value(what, histogram, std::nextafter(edge, kInf));
+    }
+  }
+}
+
+// Nanoseconds per value for adding values to histogram, the fastest of a
+// few runs.
+double time_add(const Histogram& empty, const std::vector<double>& values) {
+  double best = HUGE_VAL;
+  for (int run = 0; run < 3; run++) {
+    Histogram histogram = empty;
+    auto start = std::chrono::steady_clock::now();
+    histogram.add(values);
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, time.count());
+    sink = histogram.count(0);
+  }
+  return best / values.size() * 1e9;
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+
+  Histogram linear(0.0, 10.0, 10);
+  // low goes in the first bin, high in the bucket above the last one, and
+  // -0.0 is the same as 0.0.
+  check_lower("linear", linear, 0.0, 0.0);
+  check_lower("linear", linear, -0.0, 0.0);
+  check_lower("linear", linear, 10.0, 10.0);
+  check_upper("linear", linear, std::nextafter(10.0, 0.0), 10.0);
+  check_upper("linear", linear, std::nextafter(0.0, -1.0), 0.0);
+  check_lower("linear", linear, kInf, 10.0);
+  check_upper("linear", linear, -kInf, 0.0);
+  check_special_values("linear", linear);
+  check_random_values("linear", linear, &rng);
+  // Bins whose edges aren't exact in binary, and a range that doesn't
+  // include 0.
+  Histogram tenths(0.0, 1.0, 10);
+  check_random_values("tenths", tenths, &rng);
+  for (int i = 0; i <= 10; i++) {
+    check_value("tenths", tenths, i / 10.0);
+  }
+  Histogram offset(-3.7, 1e6, 1000);
+  check_special_values("offset", offset);
+  check_random_values("offset", offset, &rng);
+
+  Histogram log = Histogram::log_linear();
+  // Powers of two start a bucket on the positive side and end one on the
+  // negative side, as do the 16 steps between them.
+  check_lower("log-linear", log, 1.0, 1.0);
+  check_upper("log-linear", log, -1.0, -1.0);
+  check_lower("log-linear", log, 1.0625, 1.0625);
+  check_upper("log-linear", log, -1.0625, -1.0625);
+  check_lower("log-linear", log, 0x1p-64, 0x1p-64);
+  check_upper("log-linear", log, -0x1p-64, -0x1p-64);
+  check_lower("log-linear", log, 0x1p63 * 1.9375, 0x1p63 * 1.9375);
+  // Beyond the range: both zeros and subnormals share the middle bucket, and
+  // 2^64 and up the outermost ones.
+  check_upper("log-linear", log, 0.0, 0x1p-64);
+  check_upper("log-linear", log, -0.0, 0x1p-64);
+  check_upper("log-linear", log, std::numeric_limits<double>::denorm_min(),
+              0x1p-64);
+  check_lower("log-linear", log, 0x1p64, 0x1p64);
+  check_lower("log-linear", log, kInf, 0x1p64);
+  check_upper("log-linear", log, -0x1p64, -0x1p64);
+  check_upper("log-linear", log, -kInf, -0x1p64);
+  check_special_values("log-linear", log);
+  check_random_values("log-linear", log, &rng);
+
+  // Blocks of values, with NaN in some, give the same counts as adding them
+  // one at a time; and merging the histograms of two halves gives the counts
+  // of the whole.
+  std::normal_distribution<double> normal(5.0, 4.0);
+  std::vector<double> values(10000);
+  for (double& x : values) {
+    x = rng() % 100 == 0 ? NAN : normal(rng);
+  }
+  for (const Histogram* empty : {&linear, &log}) {
+    Histogram whole = *empty;
+    whole.add(values);
+    Histogram one_by_one = *empty;
+    for (double x : values) {
+      one_by_one.add({&x, 1});
+    }
+    Histogram first = *empty;
+    Histogram second = *empty;
+    first.add(std::span<const double>(values).first(3333));
+    second.add(std::span<const double>(values).subspan(3333));
+    first.merge(second);
+    if (!same_counts(whole, one_by_one) || !same_counts(whole, first)) {
+      fail(std::string(empty->is_log_linear() ? "log-linear" : "linear") +
+           " counts differ between blocks, single values and merges");
+    }
+  }
+
+  if (failures > 0) {
+    std::cerr << "histogram: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "histogram: all checks passed\n";
+
+  // All values in one bucket, where the increments would wait on each other
+  // without kCopies (see histogram.h), and spread over many.
+  std::vector<double> same(1 << 24, 5.5);
+  values.resize(1 << 24);
+  for (double& x : values) {
+    x = normal(rng);
+  }
+  std::printf("%-10s %5.2f ns/value in one bucket, %5.2f spread out\n",
+              "linear", time_add(linear, same), time_add(linear, values));
+  std::printf("%-10s %5.2f ns/value in one bucket, %5.2f spread out\n",
+              "log-linear", time_add(log, same), time_add(log, values));
+  return 0;
+}
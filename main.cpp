@@ -1,10 +1,168 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <unistd.h>
+
 #include "data_source.h"
+#include "exact_quantiles.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "rolling_stats.h"
+#include "running_stats.h"
+#include "summary.h"
+
+// Opens a text input: a data.txt-style file for --file (column is kNoColumn)
+// or a CSV file for --csv. Either may be compressed; we tell by looking at the
+// contents, and decompress while reading.
+//
+// We open the file here rather than in the data source's ctor, so we can
+// report a missing file the same way as other bad arguments.
+std::unique_ptr<DataSource> open_text_file(const std::string& filename,
+                                           uint64_t column, size_t threads) {
+  MappedFile file;
+  if (!file.open(filename)) {
+    std::cerr << "Could not open file '" << filename << "'\n";
+    return nullptr;
+  }
+  Compression compression = detect_compression(file);
+  if (!compression_supported(compression)) {
+    std::cerr << "Can't read '" << filename
+              << "': this build has no zstd support\n";
+    return nullptr;
+  }
+  if (compression != Compression::kNone) {
+    return std::make_unique<CompressedDataSource>(std::move(file), compression,
+                                                  column);
+  }
+  if (column == kNoColumn) {
+    return std::make_unique<FileDataSource>(std::move(file), threads);
+  }
+  return std::make_unique<CsvDataSource>(std::move(file), column, ',', threads);
+}
+
+// Helpers for the --cache option of --file and --csv; see cache_file.h.
+//
+// open_cached() returns a BinaryDataSource if there's an up-to-date cache for
+// filename and column, and nullptr otherwise.
+std::unique_ptr<DataSource> open_cached(const std::string& filename,
+                                        uint64_t column) {
+  CacheKey key;
+  MappedFile file;
+  std::span<const double> values;
+  if (!get_cache_key(filename, column, &key) ||
+      !open_cache(cache_path(filename, column), key, &file, &values)) {
+    return nullptr;
+  }
+  return std::make_unique<BinaryDataSource>(std::move(file), values);
+}
+
+// write_cache() wraps source so that reading it also writes the cache.
+std::unique_ptr<DataSource> write_cache(std::unique_ptr<DataSource> source,
+                                        const std::string& filename,
+                                        uint64_t column) {
+  CacheKey key;
+  if (!get_cache_key(filename, column, &key)) {
+    return source;
+  }
+  return std::make_unique<CacheWritingDataSource>(
+      std::move(source), cache_path(filename, column), key);
+}
+
+// Parses text, all of it, as a decimal number, for options like --threads=N.
+// std::strtoull() on its own would also skip leading spaces, allow trailing
+// junk, and accept a '-' sign: "-1" wraps around to 2^64 - 1.
+bool parse_size(const char* text, size_t* out) {
+  if (!std::isdigit(static_cast<unsigned char>(*text))) {
+    return false;
+  }
+  char* endptr;
+  errno = 0;
+  *out = std::strtoull(text, &endptr, 10);
+  return *endptr == '\0' && errno != ERANGE;
+}
+
+// Parses arg, a --column=N option, for a mode that reads a single column.
+// Prints an error and returns false unless it holds one column number. A list
+// of columns, like --column=1,2, only works for plain statistics (see
+// wants_columns()), so elsewhere it gets an error of its own, rather than
+// reading one of the columns.
+bool parse_single_column(const std::string& arg, size_t* column) {
+  if (parse_size(arg.c_str() + 9, column)) {
+    return true;
+  }
+  if (arg.find(',') != std::string::npos) {
+    std::cerr << "'" << arg << "' lists several columns, but this mode reads "
+              << "only one\n";
+  } else {
+    std::cerr << "Invalid column number in '" << arg << "'\n";
+  }
+  return false;
+}
+
+// Parses text, all of it, as a count of values for --count=N. Besides a
+// plain number, this takes scientific notation, so that large counts can be
+// written like 1e10 or 2.5e9, but only if it stands for a whole number that
+// fits in a size_t: "2.7", "-1" and "1e30" are all errors. We work with
+// integers throughout, since a double would round counts above 2^53.
+bool parse_count(const char* text, size_t* out) {
+  if (!std::isdigit(static_cast<unsigned char>(*text))) {
+    return false;
+  }
+  // The digits before and after the point, as one integer, and how many of
+  // them came after the point.
+  size_t mantissa = 0;
+  size_t fraction_digits = 0;
+  bool in_fraction = false;
+  const char* p = text;
+  for (; std::isdigit(static_cast<unsigned char>(*p)) ||
+         (*p == '.' && !in_fraction);
+       p++) {
+    if (*p == '.') {
+      in_fraction = true;
+      continue;
+    }
+    if (__builtin_mul_overflow(mantissa, size_t(10), &mantissa) ||
+        __builtin_add_overflow(mantissa, size_t(*p - '0'), &mantissa)) {
+      return false;
+    }
+    fraction_digits += in_fraction;
+  }
+  size_t exponent = 0;
+  if (*p == 'e' || *p == 'E') {
+    if (!parse_size(p + 1, &exponent)) {
+      return false;
+    }
+  } else if (*p != '\0') {
+    return false;
+  }
+  // The value is mantissa * 10^(exponent - fraction_digits).
+  for (; fraction_digits > exponent; fraction_digits--) {
+    if (mantissa % 10 != 0) {
+      return false;
+    }
+    mantissa /= 10;
+  }
+  for (exponent -= fraction_digits; exponent > 0 && mantissa != 0;
+       exponent--) {
+    if (__builtin_mul_overflow(mantissa, size_t(10), &mantissa)) {
+      return false;
+    }
+  }
+  *out = mantissa;
+  return true;
+}
 
 // Parse command line arguments. Here are some command lines, assuming that the
 // output program is named "stats". That's what the Makefile in this project
@@ -15,9 +173,19 @@
 //
 //   stats --stdin
 //   stats --stdin --prompt="Enter datum"
+//   producer | stats --stdin --batch
 //   stats --file=data.txt
+//   stats --file=data.txt.gz
 //   stats --csv=data.csv --column=3
+//   stats --csv=data.csv --column=3 --cache
+//   stats --csv=data.csv --column=1,2,3,7
+//   stats --csv=data.csv --columns=numeric
+//   stats --csv=data.csv --group-by=0 --column=3
+//   stats --csv=data.csv --column=3 --convert=data.bin
+//   stats --bin=data.bin
 //   stats --random-normal --mean=4.0 --stdev=0.5 --count=10
+//   stats --random-normal --count=1000000000 --generator=bulk --seed=42
+//   stats --random-normal --count=1e10 --generator=philox --threads=32
 //
 // Just look at the strings, comparing to valid inputs.  There will be lots of
 // if/else-if statements and substring comparisons.
@@ -32,108 +200,799 @@
 // Fully understanding how unique_ptr works requires understanding move
 // semantics, but you should be able to understand the basics by just reading
 // the code.
-std::unique_ptr<DataSource> get_data_source(std::vector<std::string> args) {
+//
+// threads is the --threads option (see StatsOptions below), for data sources
+// that can use more than one thread.
+std::unique_ptr<DataSource> get_data_source(std::vector<std::string> args,
+                                            size_t threads) {
   if (args.empty() || args[0] == "--stdin") {
     std::string prompt;
+    // If stdin isn't a terminal (it's a pipe or a redirected file), nobody is
+    // there to read prompts, so use the fast non-interactive reader.
+    bool batch = !isatty(STDIN_FILENO);
     for (size_t i = 1; i < args.size(); i++) {
       if (args[i].substr(0, 9) == "--prompt=") {
-        prompt = args[1].substr(9);
+        prompt = args[i].substr(9);
+      } else if (args[i] == "--batch") {
+        batch = true;
       } else {
         std::cerr << "Unrecognized option '" << args[i]
                   << "' for input --stdin\n";
         return nullptr;
       }
     }
+    if (batch) {
+      return std::make_unique<StreamDataSource>(STDIN_FILENO);
+    }
     // A helper function, to make a new unique_ptr. Pass in
     // arguments like you would for the ConsoleDataSource
     // constructor.
     return std::make_unique<ConsoleDataSource>(prompt);
   } else if (args[0].substr(0, 7) == "--file=") {
     std::string filename = args[0].substr(7);
+    bool use_cache = false;
+    for (size_t i = 1; i < args.size(); i++) {
+      if (args[i] == "--cache") {
+        use_cache = true;
+      } else {
+        std::cerr << "Unrecognized option '" << args[i]
+                  << "' for input --file\n";
+        return nullptr;
+      }
+    }
+    if (use_cache) {
+      std::unique_ptr<DataSource> cached = open_cached(filename, kNoColumn);
+      if (cached) {
+        return cached;
+      }
+    }
+    std::unique_ptr<DataSource> source =
+        open_text_file(filename, kNoColumn, threads);
+    if (source && use_cache) {
+      source = write_cache(std::move(source), filename, kNoColumn);
+    }
+    return source;
+  } else if (args[0].substr(0, 6) == "--bin=") {
+    std::string filename = args[0].substr(6);
     if (args.size() > 1) {
-      std::cerr << "Unrecognized option '" << args[1] << "' for input --file\n";
+      std::cerr << "Unrecognized option '" << args[1] << "' for input --bin\n";
       return nullptr;
     }
-    // TODO: implement FileDataSource.
-    std::cerr << "Input option --file not implemented.\n";
-    return nullptr;
+    MappedFile file;
+    if (!file.open(filename)) {
+      std::cerr << "Could not open file '" << filename << "'\n";
+      return nullptr;
+    }
+    BinaryData data;
+    if (!parse_binary(file, &data)) {
+      std::cerr << "'" << filename << "' is not a valid binary data file\n";
+      return nullptr;
+    }
+    return std::make_unique<BinaryDataSource>(std::move(file), data);
   } else if (args[0].substr(0, 6) == "--csv=") {
     std::string filename = args[0].substr(6);
     size_t column = 0;
+    bool use_cache = false;
     for (size_t i = 1; i < args.size(); i++) {
       if (args[i].substr(0, 9) == "--column=") {
-        column = std::strtoull(args[i].c_str() + 9, nullptr, 10);
+        if (!parse_single_column(args[i], &column)) {
+          return nullptr;
+        }
+      } else if (args[i] == "--cache") {
+        use_cache = true;
       } else {
         std::cerr << "Unrecognized option '" << args[i]
                   << "' for input --csv\n";
         return nullptr;
       }
     }
-    // TODO: implement CsvDataSource.
-    std::cerr << "Input option --csv not implemented\n";
-    return nullptr;
+    if (use_cache) {
+      std::unique_ptr<DataSource> cached = open_cached(filename, column);
+      if (cached) {
+        return cached;
+      }
+    }
+    std::unique_ptr<DataSource> source =
+        open_text_file(filename, column, threads);
+    if (source && use_cache) {
+      source = write_cache(std::move(source), filename, column);
+    }
+    return source;
   } else if (args[0].substr(0, 15) == "--random-normal") {
     double mean = 0.0;
     double stdev = 1.0;
     size_t count = 0;
+    size_t seed = 0;
+    RandomNormalDataSource::Generator generator =
+        RandomNormalDataSource::Generator::kStd;
     for (size_t i = 1; i < args.size(); i++) {
-      if (args[i].substr(0, 7) == "--mean=") {
+      if (args[i].substr(0, 7) == "--seed=") {
+        if (!parse_size(args[i].c_str() + 7, &seed)) {
+          std::cerr << "Invalid seed in '" << args[i]
+                    << "' (expected a whole number below 2^64)\n";
+          return nullptr;
+        }
+      } else if (args[i] == "--generator=std") {
+        generator = RandomNormalDataSource::Generator::kStd;
+      } else if (args[i] == "--generator=bulk") {
+        generator = RandomNormalDataSource::Generator::kBulk;
+      } else if (args[i] == "--generator=philox") {
+        generator = RandomNormalDataSource::Generator::kPhilox;
+      } else if (args[i].substr(0, 7) == "--mean=") {
         mean = strtod(args[i].c_str() + 7, nullptr);
       } else if (args[i].substr(0, 8) == "--stdev=") {
         stdev = strtod(args[i].c_str() + 8, nullptr);
       } else if (args[i].substr(0, 8) == "--count=") {
-        count = std::strtoull(args[i].c_str() + 8, nullptr, 10);
+        if (!parse_count(args[i].c_str() + 8, &count)) {
+          std::cerr << "Invalid count in '" << args[i]
+                    << "' (expected a whole number below 2^64, like 1000, "
+                       "1e10 or 2.5e9)\n";
+          return nullptr;
+        }
       } else {
         std::cerr << "Unrecognized option '" << args[i]
                   << "' for input --random-normal\n";
         return nullptr;
       }
     }
-    return std::make_unique<RandomNormalDataSource>(count ,mean, stdev);
+    return std::make_unique<RandomNormalDataSource>(count, mean, stdev, seed,
+                                                    generator, threads);
   } else {
     std::cerr << "Unrecognized input option '" << args[0] << "'\n";
     return nullptr;
   }
 }
 
+// Options that control how we compute statistics, rather than where the data
+// comes from. They may appear anywhere on the command line, for example:
+//
+//   stats --file=data.txt --stream
+//
+// We remove them from args, so that get_data_source() only sees its own
+// options. Returns false if an option is malformed.
+struct StatsOptions {
+  // Read the data in fixed-size batches with read_some(), instead of reading
+  // it all into memory with read(). Memory use stays constant no matter how
+  // large the input is.
+  bool stream = false;
+
+  // Like stream, but a separate thread reads batches while the main thread
+  // computes, so reading and computing overlap. See pipeline.h.
+  bool pipeline = false;
+
+  // Number of threads used to compute statistics, and by data sources that
+  // can use them (--file, --csv, and --random-normal --generator=philox).
+  // --threads=0 means one per CPU core.
+  size_t threads = 1;
+
+  // If not empty, write the input to this file in the binary format read by
+  // --bin (see binary_file.h), instead of computing statistics.
+  std::string convert;
+
+  // With convert, store float32 instead of float64 values: half the size,
+  // but only about 7 significant digits.
+  bool float32 = false;
+
+  // With --quantiles, estimate the median, p90, p99 and p99.9 with a
+  // QuantileSketch. Off by default, since the sketch makes computing the
+  // statistics about 20 times slower; see summary.h.
+  bool quantiles = false;
+
+  // Quantiles (from 0 to 1) to compute exactly, in addition to any estimates
+  // print_stats() shows. This needs all the values in memory.
+  std::vector<double> exact_quantiles;
+
+  // With --window=N, print the mean and standard deviation of the last N
+  // values after each value, instead of statistics for all of them. 0 means
+  // no window.
+  size_t window = 0;
+
+  // The buckets to count values in, for --histogram. Its counts stay zero;
+  // it's copied into each Summary. By default it has no buckets, and
+  // print_stats() doesn't show it.
+  Histogram histogram;
+};
+
+// The most --threads we accept. More threads than cores can still help while
+// some wait for the disk, and a command line written for a big machine should
+// still run on a small one, so this doesn't depend on the number of cores.
+// But tens of thousands of threads would only waste memory on their stacks,
+// and creating them can fail.
+constexpr size_t kMaxThreads = 1024;
+
+// The most memory the threads' histograms may take together. Each thread
+// fills its own copy of --histogram, which for a linear one with a million
+// bins is 32 MB, so with --threads=1024 the copies alone could take 32 GB.
+// Past this, compute_threads() uses fewer threads.
+constexpr size_t kMaxHistogramBytes = size_t(1) << 28;
+
+// The number of threads to compute the statistics on: options.threads, or
+// fewer if that many copies of the histogram would take more than
+// kMaxHistogramBytes. (Threads that only read don't need one.)
+size_t compute_threads(const StatsOptions& options) {
+  size_t bytes = std::max<size_t>(options.histogram.bytes(), 1);
+  return std::clamp<size_t>(kMaxHistogramBytes / bytes, 1, options.threads);
+}
+
+// The largest --window. RollingStats keeps the whole window in memory, at 8
+// bytes per value, so this is 1 GB.
+constexpr size_t kMaxWindow = size_t(1) << 27;
+
+bool parse_stats_options(std::vector<std::string>* args,
+                         StatsOptions* options) {
+  std::vector<std::string> rest;
+  for (const std::string& arg : *args) {
+    if (arg == "--stream") {
+      options->stream = true;
+    } else if (arg == "--pipeline") {
+      options->pipeline = true;
+    } else if (arg.substr(0, 10) == "--convert=") {
+      options->convert = arg.substr(10);
+    } else if (arg == "--float32") {
+      options->float32 = true;
+    } else if (arg == "--quantiles") {
+      options->quantiles = true;
+    } else if (arg.substr(0, 9) == "--window=") {
+      if (!parse_size(arg.c_str() + 9, &options->window) ||
+          options->window == 0 || options->window > kMaxWindow) {
+        std::cerr << "Invalid window size in '" << arg << "' (expected 1 to "
+                  << kMaxWindow << ")\n";
+        return false;
+      }
+    } else if (arg == "--histogram=log") {
+      options->histogram = Histogram::log_linear();
+    } else if (arg.substr(0, 12) == "--histogram=") {
+      // --histogram=LOW,HIGH,BINS
+      const char* p = arg.c_str() + 12;
+      char* endptr;
+      double low = std::strtod(p, &endptr);
+      bool ok = endptr != p && *endptr == ',';
+      double high = 0.0;
+      size_t bins = 0;
+      if (ok) {
+        p = endptr + 1;
+        high = std::strtod(p, &endptr);
+        ok = endptr != p && *endptr == ',';
+      }
+      if (ok) {
+        ok = parse_size(endptr + 1, &bins);
+      }
+      if (!ok || !(low < high) || !std::isfinite(high - low) || bins == 0 ||
+          bins > Histogram::kMaxBins) {
+        std::cerr << "Invalid histogram in '" << arg
+                  << "' (expected --histogram=log or "
+                     "--histogram=LOW,HIGH,BINS, with LOW < HIGH and BINS "
+                     "from 1 to "
+                  << Histogram::kMaxBins << ")\n";
+        return false;
+      }
+      options->histogram = Histogram(low, high, bins);
+    } else if (arg.substr(0, 18) == "--exact-quantiles=") {
+      // A comma-separated list, like the --column list for --csv.
+      const char* p = arg.c_str() + 18;
+      for (;;) {
+        char* endptr;
+        double q = std::strtod(p, &endptr);
+        if (endptr == p || (*endptr != ',' && *endptr != '\0') || !(q >= 0) ||
+            q > 1) {
+          std::cerr << "Invalid quantile list in '" << arg
+                    << "' (each must be from 0 to 1)\n";
+          return false;
+        }
+        options->exact_quantiles.push_back(q);
+        if (*endptr == '\0') {
+          break;
+        }
+        p = endptr + 1;
+      }
+    } else if (arg.substr(0, 10) == "--threads=") {
+      if (!parse_size(arg.c_str() + 10, &options->threads) ||
+          options->threads > kMaxThreads) {
+        std::cerr << "Invalid thread count in '" << arg << "' (expected 0 to "
+                  << kMaxThreads << ")\n";
+        return false;
+      }
+      if (options->threads == 0) {
+        // hardware_concurrency() may return 0 if it can't tell.
+        options->threads = std::max(1u, std::thread::hardware_concurrency());
+      }
+    } else {
+      rest.push_back(arg);
+    }
+  }
+  *args = rest;
+  return true;
+}
+
+// Number of values per read_some() call in --stream and --pipeline mode. 64K
+// doubles is 512 KB: big enough that the per-call overhead doesn't matter,
+// small enough to stay in the CPU's L2 or L3 cache.
+constexpr size_t kStreamBufferSize = 64 * 1024;
+
+// Number of batches in flight in --pipeline mode. The reader can get this far
+// ahead of the computation before it has to wait, which bounds memory use to
+// kPipelineSlots * kStreamBufferSize doubles (4 MB).
+constexpr size_t kPipelineSlots = 8;
+
+// Implements --convert: copies every value from data_source to a binary file.
+// Reads in batches like --stream, so inputs bigger than memory work too.
+int convert(DataSource& data_source, const StatsOptions& options) {
+  BinaryWriter writer;
+  if (!writer.open(options.convert, options.float32 ? BinaryType::kFloat32
+                                                    : BinaryType::kFloat64)) {
+    std::cerr << "Could not create file '" << options.convert << "'\n";
+    return 1;
+  }
+  std::vector<double> buffer(kStreamBufferSize);
+  while (size_t n = data_source.read_some(buffer)) {
+    if (!writer.append(std::span<const double>(buffer.data(), n))) {
+      std::cerr << "Error writing file '" << options.convert << "'\n";
+      return 1;
+    }
+  }
+  uint64_t count = writer.count();
+  if (!writer.commit()) {
+    std::cerr << "Error writing file '" << options.convert << "'\n";
+    return 1;
+  }
+  std::cout << "Wrote " << count << " values to " << options.convert << '\n';
+  return 0;
+}
+
+void print_read_summary(size_t count, double read_time, size_t read_bytes) {
+  std::cout << "Read " << count << " data in " << read_time << " seconds.\n";
+  // Throughput, so different data sources can be compared. Sources that don't
+  // read any bytes (like --random-normal) only report values per second.
+  std::cout << "Throughput: " << count / read_time << " values/s";
+  if (read_bytes > 0) {
+    std::cout << ", " << read_bytes / 1e6 / read_time << " MB/s";
+  }
+  std::cout << '\n';
+}
+
+void print_read_summary(size_t count, const DataSource& data_source) {
+  print_read_summary(count, data_source.read_time(), data_source.read_bytes());
+}
+
+// One line per bucket, tab-separated like the --group-by output. Empty
+// buckets are left out, except for the bins of a linear histogram: there are
+// thousands of log-linear buckets, and the ones beyond a linear histogram's
+// range are usually empty.
+void print_histogram(const Histogram& histogram) {
+  std::cout << "Histogram:\n";
+  std::cout << "Low\tHigh\tCount\n";
+  for (size_t i = 0; i < histogram.buckets(); i++) {
+    bool outer = std::isinf(histogram.lower(i)) ||
+                 std::isinf(histogram.upper(i));
+    if (histogram.count(i) == 0 && (outer || histogram.is_log_linear())) {
+      continue;
+    }
+    std::cout << histogram.lower(i) << '\t' << histogram.upper(i) << '\t'
+              << histogram.count(i) << '\n';
+  }
+  if (histogram.nan_count() > 0) {
+    std::cout << "nan\tnan\t" << histogram.nan_count() << '\n';
+  }
+}
+
+void print_stats(const Summary& summary) {
+  const RunningStats& stats = summary.stats();
+  std::cout << "N = " << stats.count() << '\n';
+  if (stats.count() == 0) {
+    return;
+  }
+  std::cout << "Avg = " << stats.mean() << '\n';
+  std::cout << "Var = " << stats.variance() << '\n';
+  std::cout << "Stdev = " << stats.stdev() << '\n';
+  std::cout << "Min = " << stats.min() << '\n';
+  std::cout << "Max = " << stats.max() << '\n';
+  if (stats.variance() == 0) {
+    // All the values are equal, so there's no shape to describe.
+    std::cout << "Skewness = undefined\n";
+    std::cout << "Excess kurtosis = undefined\n";
+  } else {
+    std::cout << "Skewness = " << stats.skewness() << '\n';
+    std::cout << "Excess kurtosis = " << stats.kurtosis() << '\n';
+  }
+  // Estimates, from a QuantileSketch; see quantile_sketch.h for how close.
+  if (const QuantileSketch* quantiles = summary.quantiles()) {
+    std::cout << "Median = " << quantiles->quantile(0.5) << '\n';
+    std::cout << "P90 = " << quantiles->quantile(0.9) << '\n';
+    std::cout << "P99 = " << quantiles->quantile(0.99) << '\n';
+    std::cout << "P99.9 = " << quantiles->quantile(0.999) << '\n';
+  }
+  if (summary.histogram().enabled()) {
+    print_histogram(summary.histogram());
+  }
+}
+
+// Implements --exact-quantiles for values, which it reorders. See
+// exact_quantiles.h.
+void print_exact_quantiles(std::span<double> values,
+                           const StatsOptions& options) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<double> quantiles =
+      exact_quantiles(values, options.exact_quantiles, options.threads);
+  std::chrono::duration<double> compute_time =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Computed exact quantiles in " << compute_time.count()
+            << " seconds.\n";
+  for (size_t i = 0; i < quantiles.size(); i++) {
+    std::cout << "Exact P" << options.exact_quantiles[i] * 100 << " = "
+              << quantiles[i] << '\n';
+  }
+}
+
+// Whether args ask for several CSV columns at once, as in
+//
+//   stats --csv=test.csv --column=1,2,3,7
+//   stats --csv=test.csv --columns=numeric
+//
+// Those are read by a CsvColumnsReader (see get_columns_reader()) instead of a
+// DataSource, and main() hands them to columns_main().
+bool wants_columns(const std::vector<std::string>& args) {
+  if (args.empty() || args[0].substr(0, 6) != "--csv=") {
+    return false;
+  }
+  for (const std::string& arg : args) {
+    if (arg.substr(0, 10) == "--columns=" ||
+        (arg.substr(0, 9) == "--column=" &&
+         arg.find(',') != std::string::npos)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Like get_data_source(), for several CSV columns.
+std::unique_ptr<CsvColumnsReader> get_columns_reader(
+    const std::vector<std::string>& args, size_t threads) {
+  std::string filename = args[0].substr(6);
+  std::vector<size_t> columns;
+  bool numeric = false;
+  for (size_t i = 1; i < args.size(); i++) {
+    if (args[i].substr(0, 9) == "--column=") {
+      // A comma-separated list of column numbers.
+      const char* p = args[i].c_str() + 9;
+      for (;;) {
+        char* endptr;
+        columns.push_back(std::strtoull(p, &endptr, 10));
+        if (endptr == p || (*endptr != ',' && *endptr != '\0')) {
+          std::cerr << "Invalid column list in '" << args[i] << "'\n";
+          return nullptr;
+        }
+        if (*endptr == '\0') {
+          break;
+        }
+        p = endptr + 1;
+      }
+    } else if (args[i] == "--columns=numeric") {
+      numeric = true;
+    } else {
+      std::cerr << "Unrecognized option '" << args[i]
+                << "' for input --csv with several columns\n";
+      return nullptr;
+    }
+  }
+  MappedFile file;
+  if (!file.open(filename)) {
+    std::cerr << "Could not open file '" << filename << "'\n";
+    return nullptr;
+  }
+  if (detect_compression(file) != Compression::kNone) {
+    std::cerr << "Reading several columns needs an uncompressed file\n";
+    return nullptr;
+  }
+  if (numeric) {
+    columns = CsvColumnsReader::numeric_columns(file);
+    if (columns.empty()) {
+      std::cerr << "No numeric columns in the first record of '" << filename
+                << "'\n";
+      return nullptr;
+    }
+  }
+  // The reader needs the columns in order, and each only once.
+  std::sort(columns.begin(), columns.end());
+  columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+  return std::make_unique<CsvColumnsReader>(std::move(file), columns, ',',
+                                            threads);
+}
+
+// main() for several CSV columns. We read all of them in one pass over the
+// file, then compute each column's statistics separately.
+int columns_main(const std::vector<std::string>& args,
+                 const StatsOptions& options) {
+  if (options.stream || options.pipeline || !options.convert.empty()) {
+    std::cerr << "--stream, --pipeline and --convert need a single column\n";
+    return 1;
+  }
+  std::unique_ptr<CsvColumnsReader> reader =
+      get_columns_reader(args, options.threads);
+  if (!reader) {
+    std::cerr << "Bad arguments\n";
+    return 1;
+  }
+  std::vector<std::vector<double>> columns = reader->read();
+  size_t count = 0;
+  for (const std::vector<double>& column : columns) {
+    count += column.size();
+  }
+  print_read_summary(count, reader->read_time(), reader->read_bytes());
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Summary> stats;
+  for (const std::vector<double>& column : columns) {
+    stats.push_back(parallel_accumulate(column, compute_threads(options),
+                                        Summary(options.quantiles,
+                                                options.histogram)));
+  }
+  std::chrono::duration<double> compute_time =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Computed statistics in " << compute_time.count()
+            << " seconds.\n";
+
+  for (size_t i = 0; i < stats.size(); i++) {
+    std::cout << "Column " << reader->columns()[i] << ":\n";
+    print_stats(stats[i]);
+    if (!options.exact_quantiles.empty()) {
+      print_exact_quantiles(columns[i], options);
+    }
+  }
+  return 0;
+}
+
+// main() for --window. Reads values in batches, like --stream, and prints one
+// line per value: the mean and standard deviation of the window ending there,
+// tab-separated. The lines for each batch are formatted into one buffer and
+// written together, and the output is flushed after every batch, so a
+// downstream reader sees results as soon as the input arrives (see
+// StreamDataSource) without paying for a write per line.
+int window_main(const std::vector<std::string>& args,
+                const StatsOptions& options) {
+  if (options.pipeline || !options.convert.empty() || options.quantiles ||
+      !options.exact_quantiles.empty() || options.histogram.enabled()) {
+    std::cerr << "--pipeline, --convert, --quantiles, --exact-quantiles and "
+                 "--histogram don't work with --window\n";
+    return 1;
+  }
+  std::unique_ptr<DataSource> data_source =
+      get_data_source(args, options.threads);
+  if (!data_source) {
+    std::cerr << "Bad arguments\n";
+    return 1;
+  }
+  RollingStats rolling(options.window);
+  std::vector<double> buffer(kStreamBufferSize);
+  std::vector<char> out;
+  while (size_t n = data_source->read_some(buffer)) {
+    // Each line takes at most 2 * (6 significant digits, sign, point and
+    // exponent) + 2, well under 64 characters.
+    out.resize(n * 64);
+    char* p = out.data();
+    for (size_t i = 0; i < n; i++) {
+      rolling.add(buffer[i]);
+      // std::to_chars() formats like std::cout does by default (6
+      // significant digits), but much faster, since it skips the stream
+      // machinery and the locale.
+      char* end = out.data() + out.size();
+      p = std::to_chars(p, end, rolling.mean(), std::chars_format::general, 6)
+              .ptr;
+      *p++ = '\t';
+      p = std::to_chars(p, end, rolling.stdev(), std::chars_format::general,
+                        6)
+              .ptr;
+      *p++ = '\n';
+    }
+    std::cout.write(out.data(), p - out.data());
+    std::cout.flush();
+  }
+  return 0;
+}
+
+// Whether args ask for statistics per key, as in
+//
+//   stats --csv=test.csv --group-by=0 --column=3
+bool wants_groups(const std::vector<std::string>& args) {
+  if (args.empty() || args[0].substr(0, 6) != "--csv=") {
+    return false;
+  }
+  for (const std::string& arg : args) {
+    if (arg.substr(0, 11) == "--group-by=") {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Like get_data_source(), for --group-by.
+std::unique_ptr<CsvGroupReader> get_group_reader(
+    const std::vector<std::string>& args, size_t threads) {
+  std::string filename = args[0].substr(6);
+  size_t key_column = 0;
+  size_t value_column = 0;
+  for (size_t i = 1; i < args.size(); i++) {
+    if (args[i].substr(0, 11) == "--group-by=") {
+      if (!parse_size(args[i].c_str() + 11, &key_column)) {
+        std::cerr << "Invalid column number in '" << args[i] << "'\n";
+        return nullptr;
+      }
+    } else if (args[i].substr(0, 9) == "--column=") {
+      if (!parse_single_column(args[i], &value_column)) {
+        return nullptr;
+      }
+    } else {
+      std::cerr << "Unrecognized option '" << args[i]
+                << "' for input --csv with --group-by\n";
+      return nullptr;
+    }
+  }
+  if (key_column == value_column) {
+    std::cerr << "--group-by and --column must be different columns\n";
+    return nullptr;
+  }
+  MappedFile file;
+  if (!file.open(filename)) {
+    std::cerr << "Could not open file '" << filename << "'\n";
+    return nullptr;
+  }
+  if (detect_compression(file) != Compression::kNone) {
+    std::cerr << "--group-by needs an uncompressed file\n";
+    return nullptr;
+  }
+  return std::make_unique<CsvGroupReader>(std::move(file), key_column,
+                                          value_column, ',', threads);
+}
+
+// Escapes a key for one field of tab-separated output. A quoted CSV field can
+// hold anything, including a tab or newline that would split the line, so we
+// write those as \t, \n and \r, and a backslash as \\, as PostgreSQL's and
+// MySQL's tab-separated text formats do. Other keys are printed as they are.
+std::string escape_tsv(std::string_view key) {
+  std::string escaped;
+  for (char c : key) {
+    switch (c) {
+      case '\t':
+        escaped += "\\t";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      case '\r':
+        escaped += "\\r";
+        break;
+      case '\\':
+        escaped += "\\\\";
+        break;
+      default:
+        escaped += c;
+    }
+  }
+  return escaped;
+}
+
+// main() for --group-by. The statistics are computed while reading, so
+// there's no separate compute time to report.
+int groups_main(const std::vector<std::string>& args,
+                const StatsOptions& options) {
+  if (options.stream || options.pipeline || !options.convert.empty() ||
+      options.quantiles || !options.exact_quantiles.empty() ||
+      options.histogram.enabled()) {
+    std::cerr << "--stream, --pipeline, --convert, --quantiles, "
+                 "--exact-quantiles and --histogram don't work with "
+                 "--group-by\n";
+    return 1;
+  }
+  std::unique_ptr<CsvGroupReader> reader =
+      get_group_reader(args, options.threads);
+  if (!reader) {
+    std::cerr << "Bad arguments\n";
+    return 1;
+  }
+  GroupTable groups = reader->read();
+  print_read_summary(reader->read_count(), reader->read_time(),
+                     reader->read_bytes());
+
+  // One line per key, tab-separated, so the output is easy to feed to other
+  // tools (or to sort by some other column).
+  std::cout << "Groups = " << groups.size() << '\n';
+  std::cout << "Key\tN\tAvg\tVar\tStdev\n";
+  for (const auto& [key, stats] : groups.sorted()) {
+    std::cout << escape_tsv(key) << '\t' << stats->count() << '\t'
+              << stats->mean() << '\t' << stats->variance() << '\t'
+              << stats->stdev() << '\n';
+  }
+  return 0;
+}
+
 int main(int argc, char** argv) {
   // Parse command line arguments.
   std::vector<std::string> args;
   for (int i = 1; i < argc; i++) {
     args.push_back(argv[i]);
   }
-  std::unique_ptr<DataSource> data_source = get_data_source(args);
+  StatsOptions options;
+  if (!parse_stats_options(&args, &options)) {
+    std::cerr << "Bad arguments\n";
+    return 1;
+  }
+  if (options.window > 0) {
+    return window_main(args, options);
+  }
+  if (wants_groups(args)) {
+    return groups_main(args, options);
+  }
+  if (wants_columns(args)) {
+    return columns_main(args, options);
+  }
+  std::unique_ptr<DataSource> data_source =
+      get_data_source(args, options.threads);
   if (!data_source) {
     std::cerr << "Bad arguments\n";
     return 1;
   }
 
-  // Read data, using DataSource from command line args.
-  std::vector<double> data = data_source->read();
-  std::cout << "Read " << data.size() << " data in " << data_source->read_time()
-            << " seconds.\n";
-
-  // Process data.
-  int N = data.size();
-  std::cout << "N = " << N << '\n';
-  if (N == 0) {
-    return 0;
+  if (!options.convert.empty()) {
+    return convert(*data_source, options);
   }
-  double sum = 0.0;
-  for (double d : data) {
-    sum += d;
+  if (!options.exact_quantiles.empty() &&
+      (options.stream || options.pipeline)) {
+    std::cerr << "--exact-quantiles needs all the data in memory, so it "
+                 "doesn't work with --stream or --pipeline\n";
+    return 1;
   }
-  double avg = sum / data.size();
-  std::cout << "Avg = " << avg << '\n';
 
-  double sum_diff_sq = 0.0;
-  for (double d : data) {
-    double diff = d - avg;
-    sum_diff_sq += diff * diff;
+  // Read data, using DataSource from command line args, and process it. Either
+  // way, Summary computes everything in a single pass. With the whole
+  // vector in memory, we can also split the work across threads. (--stream
+  // batches are too small for that to pay off, so --threads doesn't apply.)
+  Summary stats(options.quantiles, options.histogram);
+  if (options.pipeline) {
+    PipelineTimes times;
+    stats = pipelined_accumulate(*data_source, kStreamBufferSize,
+                                 kPipelineSlots, &times, stats);
+    print_read_summary(stats.stats().count(), *data_source);
+    std::cout << "Reader stalled " << times.reader_stall
+              << " seconds; consumer stalled " << times.consumer_stall
+              << " seconds.\n";
+  } else if (options.stream) {
+    std::vector<double> buffer(kStreamBufferSize);
+    while (size_t n = data_source->read_some(buffer)) {
+      stats.add(std::span<const double>(buffer.data(), n));
+    }
+    print_read_summary(stats.stats().count(), *data_source);
+  } else {
+    // For --bin, data borrows the mapped file's pages, so the statistics run
+    // directly on them without any copy. The pages are only read from disk as
+    // the statistics touch them, so time that too.
+    ReadResult data = data_source->read();
+    if (data.borrowed()) {
+      // Mapping takes microseconds no matter how big the file is, so a
+      // throughput computed from it would be meaningless. The real cost of
+      // reading shows up in the compute time instead.
+      std::cout << "Mapped " << data.size() << " data in "
+                << data_source->read_time()
+                << " seconds; they're read from disk while computing.\n";
+    } else {
+      print_read_summary(data.size(), *data_source);
+    }
+    auto start = std::chrono::steady_clock::now();
+    stats = parallel_accumulate(data.values(), compute_threads(options),
+                                stats);
+    std::chrono::duration<double> compute_time =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Computed statistics in " << compute_time.count()
+              << " seconds.\n";
+    if (!options.exact_quantiles.empty()) {
+      // Selection reorders the values, so it needs a copy of them if data
+      // borrows the --bin file's read-only pages. Otherwise take() just hands
+      // over the vector read() already made.
+      std::vector<double> values = data.take();
+      print_stats(stats);
+      print_exact_quantiles(values, options);
+      return 0;
+    }
   }
-  double var = sum_diff_sq / N;
-  std::cout << "Var = " << var << '\n';
-  double stdev = std::sqrt(var);
-  std::cout << "Stdev = " << stdev << '\n';
+
+  print_stats(stats);
   return 0;
 }
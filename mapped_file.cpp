@@ -0,0 +1,66 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+MappedFile::MappedFile() : data_(nullptr), size_(0) {}
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    close();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+bool MappedFile::open(const std::string& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  if (size == 0) {
+    // mmap() refuses zero-length mappings, but an empty file is still a valid
+    // (empty) input.
+    ::close(fd);
+    return true;
+  }
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file, so we can close the
+  // descriptor right away.
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  // A hint to the kernel that we'll read front to back, so it should read
+  // ahead aggressively.
+  madvise(addr, size, MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(addr);
+  size_ = size;
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// A read-only, memory-mapped view of a whole file.
+//
+// Instead of copying the file into our own buffer with read() or an ifstream,
+// we ask the operating system to map the file's pages directly into our address
+// space with mmap(). Pages are loaded lazily as we touch them, and the kernel
+// can read ahead since we tell it we'll scan the file sequentially. For large
+// files this is about as fast as the disk allows.
+//
+// MappedFile owns the mapping, so it's move-only: copying would mean two
+// objects trying to munmap() the same memory. This is the same idea as
+// std::unique_ptr, applied to a different kind of resource.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Maps the file at path. Returns false (and leaves the object empty) if the
+  // file can't be opened or mapped. An empty file opens successfully, with
+  // size() == 0.
+  bool open(const std::string& path);
+
+  // The mapped bytes. Note that the contents are NOT null-terminated, so never
+  // pass begin() to a C string function like strtod().
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+  size_t size() const { return size_; }
+
+ private:
+  void close();
+
+  const char* data_;
+  size_t size_;
+};
+
+#endif  // MAPPED_FILE_H
@@ -0,0 +1,69 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <span>
+#include <thread>
+#include <vector>
+
+// Calls f(0), f(1), ..., f(threads - 1), each on its own thread, and waits for
+// all of them to finish. The calling thread runs the last call itself, instead
+// of sitting idle. f must be safe to call from several threads at once; the
+// usual approach is to have call t only write to data owned by index t.
+template <typename F>
+void parallel_for(size_t threads, const F& f) {
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t + 1 < threads; t++) {
+    workers.emplace_back([&f, t] { f(t); });
+  }
+  if (threads > 0) {
+    f(threads - 1);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+// Accumulates values using several threads.
+//
+// Accumulator is any type with these methods (RunningStats is one):
+//
+//     void add(std::span<const double> values);
+//     void merge(const Accumulator& other);
+//
+// We split values into `threads` contiguous chunks of (nearly) equal size. Each
+// thread adds its chunk to its own copy of init, so the threads never share
+// anything while they work. Then we merge the per-thread results pairwise, like
+// a tournament bracket: 0+1, 2+3, ..., then (0+1)+(2+3), and so on.
+//
+// Floating point addition isn't associative, so the order of merges affects the
+// last few bits of the result. Because the chunks and the merge order depend
+// only on values.size() and threads, running with the same number of threads
+// always gives exactly the same answer.
+//
+// This is a template, so it has to be defined in the header: the compiler
+// needs to see the code to generate a version for each Accumulator type.
+template <typename Accumulator>
+Accumulator parallel_accumulate(std::span<const double> values, size_t threads,
+                                const Accumulator& init = Accumulator()) {
+  if (threads < 1) {
+    threads = 1;
+  }
+  std::vector<Accumulator> results(threads, init);
+  // The lambda captures `values` and `results` by reference. Each thread only
+  // touches its own element of results, so no locking is needed.
+  parallel_for(threads, [&values, &results, threads](size_t t) {
+    size_t begin = values.size() * t / threads;
+    size_t end = values.size() * (t + 1) / threads;
+    results[t].add(values.subspan(begin, end - begin));
+  });
+
+  for (size_t step = 1; step < threads; step *= 2) {
+    for (size_t i = 0; i + step < threads; i += 2 * step) {
+      results[i].merge(results[i + step]);
+    }
+  }
+  return results[0];
+}
+
+#endif  // PARALLEL_H
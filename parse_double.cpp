@@ -0,0 +1,61 @@
+#include "parse_double.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <system_error>
+
+const char* parse_double(const char* first, const char* last, double* out) {
+  // std::from_chars doesn't accept a leading '+', but strtod() and our users
+  // do.
+  if (first != last && *first == '+') {
+    ++first;
+    if (first != last && *first == '-') {
+      return nullptr;
+    }
+  }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  // std::from_chars (C++17) is the fastest correct parser in the standard
+  // library. Recent implementations (GCC 12+, MSVC) use the Eisel-Lemire
+  // algorithm from the fast_float project, which handles almost every input
+  // with a few integer multiplications and no big-number arithmetic.
+  double d;
+  std::from_chars_result result = std::from_chars(first, last, d);
+  if (result.ec != std::errc()) {
+    return nullptr;
+  }
+  *out = d;
+  return result.ptr;
+#else
+  // Older standard libraries only have from_chars for integers. Fall back to
+  // strtod() on a null-terminated copy. Numbers longer than the buffer are
+  // unusual enough that we just reject them.
+  //
+  // strtod() reads the decimal point from the C library's locale. That's
+  // always the "C" locale, with '.', unless the program calls setlocale(),
+  // which this one never does. We make the other differences from
+  // from_chars() match the header's description: the copy stops at an 'x',
+  // so "0x1p3" parses as 0, and results out of range fail.
+  char buf[128];
+  size_t len = std::min<size_t>(last - first, sizeof(buf) - 1);
+  len = std::find_if(first, first + len,
+                     [](char c) { return c == 'x' || c == 'X'; }) -
+        first;
+  std::copy(first, first + len, buf);
+  buf[len] = '\0';
+  if (len == 0 || std::isspace(static_cast<unsigned char>(buf[0]))) {
+    return nullptr;
+  }
+  char* endptr;
+  errno = 0;
+  double d = std::strtod(buf, &endptr);
+  if (endptr == buf || (errno == ERANGE && (d == 0 || std::isinf(d)))) {
+    return nullptr;
+  }
+  *out = d;
+  return first + (endptr - buf);
+#endif
+}
@@ -0,0 +1,34 @@
+#ifndef PARSE_DOUBLE_H
+#define PARSE_DOUBLE_H
+
+// The number parser shared by every text-based DataSource.
+//
+// Parses a double at the start of [first, last). On success, stores the value
+// in *out and returns a pointer to the first character after the number. On
+// failure (no number at first, or the value is out of range), returns nullptr
+// and leaves *out unchanged.
+//
+// Compared to std::strtod(), parse_double():
+//
+// 1.  Works on a range, so the input doesn't have to be a null-terminated
+//     string. We can parse straight out of a memory-mapped file or a read
+//     buffer without copying.
+// 2.  Ignores the locale. strtod() has to check the current locale for the
+//     decimal point character, which is slow, and it means "1.5" might not
+//     parse in a German locale. Our files always use '.'.
+// 3.  Doesn't skip leading whitespace. Callers decide what spacing is allowed.
+//
+// Like strtod(), it accepts an optional sign (including '+'), decimal or
+// scientific notation, and "inf", "infinity" and "nan" in any case. For those,
+// results are correctly rounded, so they match strtod() bit for bit
+// (parse_double_test.cpp checks). It differs from strtod() on a few inputs
+// that don't appear in our data files:
+//
+// - Hexadecimal floats, like "0x1p3": only the "0" is a number, as if the
+//   "x1p3" were text after it.
+// - Values too large for a double ("1e400"), or so small they round to zero
+//   ("1e-400"), fail. strtod() returns infinity or 0 for them, and sets
+//   errno. Values small enough to be subnormal, like "1e-310", still parse.
+const char* parse_double(const char* first, const char* last, double* out);
+
+#endif  // PARSE_DOUBLE_H
@@ -0,0 +1,165 @@
+// Checks parse_double() against std::strtod(), and times both. Run it with
+// `make check`.
+//
+// Every input parse_double() accepts should give the same double, bit for
+// bit, and stop at the same character as strtod() does. The inputs are
+// formatted the ways numbers show up in our data files: the shortest
+// round-trip form (like Python's, which writes data.txt), fixed and
+// scientific notation with a few digits, and random bit patterns that cover
+// every exponent. The few documented differences (see parse_double.h) are
+// checked separately.
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "parse_double.h"
+
+namespace {
+
+int failures = 0;
+
+// time_parse() stores its results here, so the compiler can't skip the
+// parsing as unused.
+volatile double sink;
+
+// Parses text with both functions and reports any difference.
+void check_matches_strtod(const std::string& text) {
+  char* strtod_end;
+  double expected = std::strtod(text.c_str(), &strtod_end);
+  double actual = 0.0;
+  const char* end =
+      parse_double(text.data(), text.data() + text.size(), &actual);
+  bool same =
+      end != nullptr && end - text.data() == strtod_end - text.c_str() &&
+      (std::bit_cast<uint64_t>(actual) == std::bit_cast<uint64_t>(expected) ||
+       (std::isnan(actual) && std::isnan(expected)));
+  if (!same && ++failures <= 10) {
+    std::cerr << "'" << text << "': strtod() gives " << expected
+              << ", parse_double() "
+              << (end == nullptr ? std::string("fails")
+                                 : std::to_string(actual))
+              << '\n';
+  }
+}
+
+// Checks one of the inputs where parse_double() is documented to differ.
+// consumed is the number of characters it should parse, or 0 if it should
+// fail.
+void check_differs(const std::string& text, size_t consumed, double value) {
+  double actual = -1.0;
+  const char* end =
+      parse_double(text.data(), text.data() + text.size(), &actual);
+  bool ok = consumed == 0
+                ? end == nullptr
+                : end == text.data() + consumed && actual == value;
+  if (!ok && ++failures <= 10) {
+    std::cerr << "'" << text << "': unexpected result from parse_double()\n";
+  }
+}
+
+std::string format(const char* spec, double d) {
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), spec, d);
+  return buf;
+}
+
+std::string shortest(double d) {
+  char buf[64];
+  return std::string(buf, std::to_chars(buf, buf + sizeof(buf), d).ptr);
+}
+
+// Returns the time per value, in nanoseconds, to parse every line of text
+// with parse(first, last, &d), which returns the end of the number. The
+// fastest of a few runs, to leave out noise from other programs.
+template <typename Parse>
+double time_parse(const std::string& text, size_t count, const Parse& parse) {
+  double best = HUGE_VAL;
+  double sum = 0.0;
+  for (int run = 0; run < 5; run++) {
+    auto start = std::chrono::steady_clock::now();
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p != end) {
+      double d;
+      p = parse(p, end, &d) + 1;  // Skip the newline.
+      sum += d;
+    }
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, time.count());
+  }
+  sink = sum;
+  return best * 1e9 / count;
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal(0.0, 100.0);
+  size_t checked = 0;
+  for (int i = 0; i < 250000; i++) {
+    double d = normal(rng);
+    check_matches_strtod(shortest(d));
+    check_matches_strtod(format("%.6f", d));
+    check_matches_strtod(format("%.3e", d));
+    check_matches_strtod(format("%.17g", d));
+    // Any finite double, including subnormals.
+    double any = std::bit_cast<double>(rng());
+    if (std::isfinite(any)) {
+      check_matches_strtod(shortest(any));
+      checked++;
+    }
+    checked += 4;
+  }
+  const char* special[] = {
+      "0",        "-0",       "+5",     ".5",      "5.",       "1e",
+      "1e+",      "-1.5e-3",  "1E5",    "inf",     "-inf",     "INFINITY",
+      "nan",      "NaN",      "nan(1)", "1e-310",  "4.9e-324", "12abc",
+      "1.5,2.5",  "3\r",      "007",    "1e0001",  "9007199254740993",
+      "1.7976931348623157e308", "2.2250738585072011e-308"};
+  for (const char* text : special) {
+    check_matches_strtod(text);
+    checked++;
+  }
+  check_differs("0x1p3", 1, 0.0);
+  check_differs("1e400", 0, 0.0);
+  check_differs("-1e400", 0, 0.0);
+  check_differs("1e-400", 0, 0.0);
+  check_differs(" 5", 0, 0.0);
+  check_differs("", 0, 0.0);
+  check_differs("+-5", 0, 0.0);
+  if (failures > 0) {
+    std::cerr << "parse_double: " << failures << " of " << checked
+              << " inputs failed\n";
+    return 1;
+  }
+  std::cout << "parse_double: " << checked << " inputs match strtod()\n";
+
+  // Time data.txt-style input: one value per line, in shortest form.
+  std::string text;
+  size_t count = 1000000;
+  for (size_t i = 0; i < count; i++) {
+    text += shortest(normal(rng));
+    text += '\n';
+  }
+  double ours = time_parse(text, count, parse_double);
+  double theirs = time_parse(
+      text, count, [](const char* first, const char*, double* d) {
+        char* end;
+        *d = std::strtod(first, &end);
+        return static_cast<const char*>(end);
+      });
+  std::cout << "parse_double: " << ours << " ns/value; strtod: " << theirs
+            << " ns/value\n";
+  return 0;
+}
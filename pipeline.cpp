@@ -0,0 +1,65 @@
+#include "pipeline.h"
+
+BatchRing::BatchRing(size_t slots, size_t batch_size)
+    : slots_(slots),
+      batch_size_(batch_size),
+      buffer_(slots * batch_size),
+      sizes_(slots),
+      head_(0),
+      tail_(0),
+      producer_stall_time_(0.0),
+      consumer_stall_time_(0.0) {}
+
+std::span<double> BatchRing::begin_write() {
+  size_t head = head_.load(std::memory_order_relaxed);
+  size_t tail = tail_.load(std::memory_order_acquire);
+  if (head - tail == slots_) {
+    // Full. Only look at the clock when we actually have to wait, so the fast
+    // path stays fast.
+    auto start = std::chrono::steady_clock::now();
+    while (head - tail == slots_) {
+      // Sleeps until tail_ changes from `tail`.
+      tail_.wait(tail, std::memory_order_acquire);
+      tail = tail_.load(std::memory_order_acquire);
+    }
+    std::chrono::duration<double> dur =
+        std::chrono::steady_clock::now() - start;
+    producer_stall_time_ += dur.count();
+  }
+  return std::span<double>(buffer_.data() + (head % slots_) * batch_size_,
+                           batch_size_);
+}
+
+void BatchRing::end_write(size_t n) {
+  size_t head = head_.load(std::memory_order_relaxed);
+  sizes_[head % slots_] = n;
+  // The release store makes the batch contents and its size visible to the
+  // consumer before (or together with) the new head_.
+  head_.store(head + 1, std::memory_order_release);
+  head_.notify_one();
+}
+
+std::span<const double> BatchRing::begin_read() {
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  size_t head = head_.load(std::memory_order_acquire);
+  if (head == tail) {
+    // Empty.
+    auto start = std::chrono::steady_clock::now();
+    while (head == tail) {
+      head_.wait(head, std::memory_order_acquire);
+      head = head_.load(std::memory_order_acquire);
+    }
+    std::chrono::duration<double> dur =
+        std::chrono::steady_clock::now() - start;
+    consumer_stall_time_ += dur.count();
+  }
+  size_t slot = tail % slots_;
+  return std::span<const double>(buffer_.data() + slot * batch_size_,
+                                 sizes_[slot]);
+}
+
+void BatchRing::end_read() {
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  tail_.store(tail + 1, std::memory_order_release);
+  tail_.notify_one();
+}
@@ -0,0 +1,110 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "data_source.h"
+
+// A fixed-size, lock-free queue of batches of doubles, for exactly one
+// producer thread and one consumer thread.
+//
+// The ring holds `slots` buffers of `batch_size` doubles each, allocated once
+// up front, so memory use is bounded no matter how much data flows through.
+// The producer fills a slot and publishes it; the consumer reads it and hands
+// it back. If the producer gets `slots` batches ahead, it waits for the
+// consumer to catch up ("backpressure"), and if the consumer runs out of
+// batches, it waits for the producer.
+//
+// With one producer and one consumer we don't need a mutex. Each side owns one
+// counter: the producer only writes head_, the consumer only writes tail_, and
+// each just reads the other's. std::atomic, with acquire/release ordering,
+// guarantees that once the consumer sees the new head_, it also sees the data
+// the producer wrote before updating it. Waiting uses C++20's atomic wait() and
+// notify_one(), which sleep instead of spinning.
+class BatchRing {
+ public:
+  BatchRing(size_t slots, size_t batch_size);
+
+  // Producer side. begin_write() waits for a free slot and returns its buffer;
+  // end_write(n) publishes the first n values of it. Publishing 0 values
+  // marks the end of the data.
+  std::span<double> begin_write();
+  void end_write(size_t n);
+
+  // Consumer side. begin_read() waits for a published batch and returns it;
+  // an empty span means the producer is done. end_read() returns the slot to
+  // the producer.
+  std::span<const double> begin_read();
+  void end_read();
+
+  // Total seconds each side spent waiting on the other. Only read these after
+  // both threads are finished.
+  double producer_stall_time() const { return producer_stall_time_; }
+  double consumer_stall_time() const { return consumer_stall_time_; }
+
+ private:
+  size_t slots_;
+  size_t batch_size_;
+  std::vector<double> buffer_;
+  std::vector<size_t> sizes_;
+
+  // Counts of batches written and read. They only ever increase; the slot for
+  // batch i is i % slots_. alignas(64) puts each on its own cache line, so the
+  // two threads don't slow each other down by writing to the same line.
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+
+  double producer_stall_time_;
+  double consumer_stall_time_;
+};
+
+// Timing for pipelined_accumulate(), in seconds.
+struct PipelineTimes {
+  // Time the reader thread waited for the consumer to free a slot.
+  double reader_stall = 0.0;
+  // Time the consumer waited for the reader to produce a batch.
+  double consumer_stall = 0.0;
+};
+
+// Like parallel_accumulate() in parallel.h, but overlaps reading with
+// computing. A reader thread calls data_source.read_some() into a BatchRing
+// while the calling thread adds each batch to an Accumulator. Time spent inside
+// read_some() is available from data_source.read_time() as usual; the time
+// each side spent waiting on the other goes in *times.
+template <typename Accumulator>
+Accumulator pipelined_accumulate(DataSource& data_source, size_t batch_size,
+                                 size_t slots, PipelineTimes* times,
+                                 const Accumulator& init = Accumulator()) {
+  BatchRing ring(slots, batch_size);
+  std::thread reader([&data_source, &ring] {
+    for (;;) {
+      std::span<double> batch = ring.begin_write();
+      size_t n = data_source.read_some(batch);
+      ring.end_write(n);
+      if (n == 0) {
+        break;
+      }
+    }
+  });
+
+  Accumulator result = init;
+  for (;;) {
+    std::span<const double> batch = ring.begin_read();
+    if (batch.empty()) {
+      break;
+    }
+    result.add(batch);
+    ring.end_read();
+  }
+  reader.join();
+  times->reader_stall = ring.producer_stall_time();
+  times->consumer_stall = ring.consumer_stall_time();
+  return result;
+}
+
+#endif  // PIPELINE_H
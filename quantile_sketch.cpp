@@ -0,0 +1,249 @@
+#include "quantile_sketch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace {
+
+// How many values add() collects before sorting them into the centroids, as a
+// multiple of the compression. A bigger buffer means fewer, larger merges, so
+// the centroids are walked less often per value; 40 * 200 values (64 KB) still
+// sort within the L2 cache.
+constexpr size_t kBufferFactor = 40;
+
+// Sorting the buffer is most of the cost of add(), so we use a radix sort,
+// which takes a fixed number of passes over the data no matter how many values
+// there are, instead of std::sort()'s log2(n). Radix sorts work on integer
+// keys, so first we map each double to an unsigned integer in the same order.
+//
+// For non-negative doubles, the bits already sort correctly as integers
+// (that's by design in IEEE 754), as long as they stay above all the negative
+// ones; setting the sign bit does that. Negative doubles sort in reverse of
+// their bits, so flipping all the bits fixes the order and clears the sign.
+uint64_t to_key(double x) {
+  uint64_t bits = std::bit_cast<uint64_t>(x);
+  return bits >> 63 ? ~bits : bits | (uint64_t(1) << 63);
+}
+
+double from_key(uint64_t key) {
+  return std::bit_cast<double>(key >> 63 ? key & ~(uint64_t(1) << 63) : ~key);
+}
+
+// Least-significant-digit radix sort, kDigitBits at a time. Each pass is a
+// stable counting sort on one digit, from *keys to *scratch or back. The
+// counts for all passes come from a single read of the keys, and a pass is
+// skipped when every key has the same digit (common for the top digits,
+// which hold the sign and exponent).
+constexpr int kDigitBits = 11;
+constexpr int kPasses = (64 + kDigitBits - 1) / kDigitBits;
+constexpr size_t kDigits = size_t(1) << kDigitBits;
+
+void radix_sort(std::vector<uint64_t>* keys, std::vector<uint64_t>* scratch) {
+  size_t n = keys->size();
+  if (n < 2) {
+    return;
+  }
+  scratch->resize(n);
+  uint32_t counts[kPasses][kDigits] = {};
+  for (uint64_t key : *keys) {
+    for (int pass = 0; pass < kPasses; pass++) {
+      counts[pass][(key >> (pass * kDigitBits)) & (kDigits - 1)]++;
+    }
+  }
+  uint64_t* from = keys->data();
+  uint64_t* to = scratch->data();
+  for (int pass = 0; pass < kPasses; pass++) {
+    int shift = pass * kDigitBits;
+    uint32_t* count = counts[pass];
+    if (count[(from[0] >> shift) & (kDigits - 1)] == n) {
+      continue;
+    }
+    // Turn the counts into the position where each digit's keys start.
+    uint32_t offset = 0;
+    for (size_t d = 0; d < kDigits; d++) {
+      uint32_t c = count[d];
+      count[d] = offset;
+      offset += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      to[count[(from[i] >> shift) & (kDigits - 1)]++] = from[i];
+    }
+    std::swap(from, to);
+  }
+  if (from != keys->data()) {
+    std::copy(from, from + n, keys->data());
+  }
+}
+
+// The "scale function" k1 from the paper. A centroid covering the quantiles
+// [q_left, q_right] may only grow while k(q_right) - k(q_left) <= 1. The
+// slope of asin() is steepest near q = 0 and q = 1, so centroids there stay
+// small.
+double scale(double q, double compression) {
+  return compression / (2 * std::numbers::pi) * std::asin(2 * q - 1);
+}
+
+// The inverse of scale(): the quantile q where scale(q) == k.
+double inverse_scale(double k, double compression) {
+  double x = k * 2 * std::numbers::pi / compression;
+  if (x >= std::numbers::pi / 2) {
+    return 1.0;
+  }
+  return (std::sin(x) + 1) / 2;
+}
+
+}  // namespace
+
+QuantileSketch::QuantileSketch(double compression)
+    : compression_(compression),
+      centroid_weight_(0.0),
+      min_(std::numeric_limits<double>::infinity()),
+      max_(-std::numeric_limits<double>::infinity()) {
+  buffer_.reserve(kBufferFactor * compression_);
+}
+
+void QuantileSketch::add(double x) {
+  add(std::span<const double>(&x, 1));
+}
+
+void QuantileSketch::add(std::span<const double> values) {
+  size_t capacity = kBufferFactor * compression_;
+  for (double x : values) {
+    // NaN has no place in sorted order (and would confuse std::sort), so it's
+    // left out.
+    if (std::isnan(x)) {
+      continue;
+    }
+    min_ = std::min(min_, x);
+    max_ = std::max(max_, x);
+    buffer_.push_back(to_key(x));
+    if (buffer_.size() == capacity) {
+      flush();
+    }
+  }
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+  flush();
+  if (other.count() == 0) {
+    return;
+  }
+  // Merge other's centroids and (sorted) buffer into ours, then compress. The
+  // inputs are all sorted already, so std::merge does it in linear time.
+  std::vector<uint64_t> other_buffer = other.buffer_;
+  std::sort(other_buffer.begin(), other_buffer.end());
+  std::vector<Centroid> theirs(other.centroids_.size() + other_buffer.size());
+  auto by_mean = [](const Centroid& a, const Centroid& b) {
+    return a.mean < b.mean;
+  };
+  std::transform(other_buffer.begin(), other_buffer.end(), theirs.begin(),
+                 [](uint64_t key) { return Centroid{from_key(key), 1.0}; });
+  std::copy(other.centroids_.begin(), other.centroids_.end(),
+            theirs.begin() + other_buffer.size());
+  std::inplace_merge(theirs.begin(), theirs.begin() + other_buffer.size(),
+                     theirs.end(), by_mean);
+  std::vector<Centroid> all(centroids_.size() + theirs.size());
+  std::merge(centroids_.begin(), centroids_.end(), theirs.begin(),
+             theirs.end(), all.begin(), by_mean);
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+  compress(all, centroid_weight_ + other.count());
+}
+
+size_t QuantileSketch::count() const {
+  return static_cast<size_t>(centroid_weight_) + buffer_.size();
+}
+
+double QuantileSketch::quantile(double q) const {
+  if (!buffer_.empty()) {
+    // Sort the buffer in on a copy, so that quantile() can be const.
+    QuantileSketch flushed = *this;
+    flushed.flush();
+    return flushed.quantile(q);
+  }
+  if (centroids_.empty()) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  if (q <= 0) {
+    return min_;
+  }
+  if (q >= 1) {
+    return max_;
+  }
+  // Think of each centroid's values as spread evenly around its mean, so its
+  // mean sits at the middle of its share of the ranks. The minimum is at rank
+  // 0 and the maximum at rank N. Between those points, interpolate linearly.
+  double rank = q * centroid_weight_;
+  double prev_rank = 0.0;
+  double prev_value = min_;
+  double cumulative = 0.0;
+  for (const Centroid& c : centroids_) {
+    double center = cumulative + c.weight / 2;
+    if (rank < center) {
+      double t = (rank - prev_rank) / (center - prev_rank);
+      return prev_value + t * (c.mean - prev_value);
+    }
+    prev_rank = center;
+    prev_value = c.mean;
+    cumulative += c.weight;
+  }
+  double t = (rank - prev_rank) / (centroid_weight_ - prev_rank);
+  return prev_value + t * (max_ - prev_value);
+}
+
+void QuantileSketch::flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+  radix_sort(&buffer_, &sort_scratch_);
+  std::vector<Centroid>& all = merge_scratch_;
+  all.resize(centroids_.size() + buffer_.size());
+  // Merge the sorted buffer, as centroids of one value each, with the
+  // existing centroids.
+  auto out = all.begin();
+  auto c = centroids_.begin();
+  for (uint64_t key : buffer_) {
+    double x = from_key(key);
+    while (c != centroids_.end() && c->mean < x) {
+      *out++ = *c++;
+    }
+    *out++ = Centroid{x, 1.0};
+  }
+  std::copy(c, centroids_.end(), out);
+  double total = centroid_weight_ + buffer_.size();
+  buffer_.clear();
+  compress(all, total);
+}
+
+void QuantileSketch::compress(const std::vector<Centroid>& sorted,
+                              double total_weight) {
+  centroids_.clear();
+  centroid_weight_ = total_weight;
+  if (sorted.empty()) {
+    return;
+  }
+  // Walk through the centroids in order, merging each into the current one
+  // while the result stays within the size limit for its position.
+  double done = 0.0;
+  double limit =
+      total_weight * inverse_scale(scale(0, compression_) + 1, compression_);
+  Centroid current = sorted[0];
+  for (size_t i = 1; i < sorted.size(); i++) {
+    const Centroid& next = sorted[i];
+    if (done + current.weight + next.weight <= limit) {
+      current.weight += next.weight;
+      current.mean += (next.mean - current.mean) * next.weight / current.weight;
+    } else {
+      done += current.weight;
+      centroids_.push_back(current);
+      limit = total_weight * inverse_scale(
+                                 scale(done / total_weight, compression_) + 1,
+                                 compression_);
+      current = next;
+    }
+  }
+  centroids_.push_back(current);
+}
@@ -0,0 +1,85 @@
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Estimates quantiles (the median, p99, ...) in a single pass, in a small,
+// fixed amount of memory. This is a "t-digest", from Ted Dunning and Otmar
+// Ertl, "Computing Extremely Accurate Quantiles Using t-Digests":
+//
+//     https://arxiv.org/abs/1902.04023
+//
+// Exact quantiles need all of the data, sorted. A t-digest instead keeps a few
+// hundred "centroids": clusters of nearby values, each summarized by its mean
+// and how many values it holds. Values are sorted into the digest in batches,
+// and neighboring centroids are merged as long as the merged one stays under a
+// size limit. The trick is that the limit depends on where the centroid is: in
+// the middle of the distribution, a centroid may hold a few percent of all the
+// values, but near the ends it must be tiny, down to single values. So the
+// tails, where p99 and p99.9 live, are described in much more detail than the
+// middle, where a small error in rank barely moves the value.
+//
+// Quantiles are estimated by interpolating between centroids. With the default
+// compression of 200 (a few hundred centroids; about 260 KB in all, most of it
+// the buffer of unsorted values and the space to sort it), on 10^7 normally
+// distributed values, the estimates for p0.1 through p99.9 were all off by
+// less than 0.01% of the data in rank: the median estimate sits between the
+// true p49.99 and p50.01. Skewed data, heavy duplicates and sketches merged
+// from several threads do worse, but stay within 0.1%; quantile_sketch_test
+// checks both bounds. The error doesn't grow with the amount of data.
+// Adding a value costs about 35 ns, most of it in sorting the buffer.
+//
+// Like RunningStats, two sketches of different data can be merge()d, which is
+// what lets parallel_accumulate() and the pipeline build one per thread or
+// batch. The result depends only on the data and the order of adds and
+// merges, so runs are reproducible.
+class QuantileSketch {
+ public:
+  // Higher compression means more centroids: more memory and time, less
+  // error.
+  explicit QuantileSketch(double compression = 200);
+
+  // NaN values are ignored.
+  void add(double x);
+  void add(std::span<const double> values);
+
+  // Combine with a sketch of other data.
+  void merge(const QuantileSketch& other);
+
+  size_t count() const;
+
+  // Estimates the q-th quantile, for q from 0 (the minimum) to 1 (the
+  // maximum). NaN if there's no data.
+  double quantile(double q) const;
+
+ private:
+  struct Centroid {
+    double mean;
+    double weight;
+  };
+
+  double compression_;
+  // Sorted by mean.
+  std::vector<Centroid> centroids_;
+  double centroid_weight_;
+  // Values added since the last flush(), not sorted yet. They're stored as
+  // sort keys; see quantile_sketch.cpp.
+  std::vector<uint64_t> buffer_;
+  // Space for flush() to sort buffer_ and merge it with centroids_, kept to
+  // avoid allocating it every time.
+  std::vector<uint64_t> sort_scratch_;
+  std::vector<Centroid> merge_scratch_;
+  double min_;
+  double max_;
+
+  // Sorts buffer_ into centroids_.
+  void flush();
+  // Replaces centroids_ with a compressed version of sorted, which holds
+  // total_weight values in all.
+  void compress(const std::vector<Centroid>& sorted, double total_weight);
+};
+
+#endif  // QUANTILE_SKETCH_H
@@ -0,0 +1,160 @@
+// Checks that QuantileSketch's estimates stay within the rank errors stated
+// in quantile_sketch.h for p0.1 through p99.9, and times add(). Run it with
+// `make check`.
+//
+// The error is measured in rank, against the sorted data: how far the rank
+// of the estimate is from q * n. Uniform, normal and skewed data each stress
+// a different part of the digest, and with heavy duplicates, many values
+// share one rank range, which a centroid can straddle. Sketches built per
+// thread and merged, as parallel_accumulate() merges them, must stay within
+// the same bound as one sketch of all the data.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "quantile_sketch.h"
+
+namespace {
+
+// The bounds from quantile_sketch.h, as fractions of the data: for any data,
+// and for normal data in a single sketch.
+constexpr double kMaxRankError = 1e-3;
+constexpr double kMaxNormalRankError = 1e-4;
+
+int failures = 0;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+// How far the rank of x in sorted is from q * n, as a fraction of n. With
+// duplicates, x covers a range of ranks, and any rank in it will do.
+double rank_error(const std::vector<double>& sorted, double q, double x) {
+  double n = sorted.size();
+  double first = std::lower_bound(sorted.begin(), sorted.end(), x) -
+                 sorted.begin();
+  double last = std::upper_bound(sorted.begin(), sorted.end(), x) -
+                sorted.begin();
+  double rank = q * n;
+  return std::max({first - rank, rank - last, 0.0}) / n;
+}
+
+// The worst rank error of sketch over p0.1 through p99.9.
+double worst_error(const QuantileSketch& sketch,
+                   const std::vector<double>& sorted) {
+  double worst = 0;
+  for (double q : {0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999}) {
+    worst = std::max(worst, rank_error(sorted, q, sketch.quantile(q)));
+  }
+  return worst;
+}
+
+// Checks sketches of values: one of all of them, which must be within
+// max_error, and one merged from per-thread sketches.
+void check(const std::string& what, std::vector<double> values,
+           double max_error = kMaxRankError) {
+  QuantileSketch one;
+  one.add(values);
+  // Per-thread sketches of consecutive shares of the data, merged in order.
+  const size_t kThreads = 8;
+  std::vector<QuantileSketch> sketches(kThreads);
+  std::span<const double> all(values);
+  for (size_t t = 0; t < kThreads; t++) {
+    sketches[t].add(all.subspan(t * all.size() / kThreads,
+                                (t + 1) * all.size() / kThreads -
+                                    t * all.size() / kThreads));
+  }
+  for (size_t t = 1; t < kThreads; t++) {
+    sketches[0].merge(sketches[t]);
+  }
+
+  std::sort(values.begin(), values.end());
+  double one_error = worst_error(one, values);
+  double merged_error = worst_error(sketches[0], values);
+  std::printf("%-20s worst rank error %.1e, %.1e merged from %zu threads\n",
+              what.c_str(), one_error, merged_error, kThreads);
+  if (one.count() != values.size() || sketches[0].count() != values.size()) {
+    fail(what + ": the sketch lost values");
+  }
+  if (!(one_error <= max_error)) {
+    fail(what + ": rank error " + std::to_string(one_error));
+  }
+  if (!(merged_error <= kMaxRankError)) {
+    fail(what + ": rank error " + std::to_string(merged_error) +
+         " after merging");
+  }
+  // The ends are exact.
+  if (one.quantile(0) != values.front() || one.quantile(1) != values.back() ||
+      sketches[0].quantile(0) != values.front() ||
+      sketches[0].quantile(1) != values.back()) {
+    fail(what + ": wrong minimum or maximum");
+  }
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  const size_t kValues = 1 << 22;
+  std::vector<double> values(kValues);
+
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  for (double& x : values) {
+    x = uniform(rng);
+  }
+  check("uniform", values);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (double& x : values) {
+    x = normal(rng);
+  }
+  check("normal", values, kMaxNormalRankError);
+  // Skewed: a long right tail, spanning many orders of magnitude.
+  std::lognormal_distribution<double> lognormal(0.0, 2.0);
+  for (double& x : values) {
+    x = lognormal(rng);
+  }
+  check("lognormal", values);
+  // Already sorted, so each batch the sketch sees lies beyond the last.
+  std::sort(values.begin(), values.end());
+  check("sorted lognormal", values);
+  // Duplicate-heavy: a few distinct values, and mostly one value with a
+  // spread of others around it.
+  for (double& x : values) {
+    x = rng() % 10;
+  }
+  check("10 distinct values", values);
+  for (double& x : values) {
+    x = rng() % 10 == 0 ? normal(rng) : 0.0;
+  }
+  check("90% zeros", values);
+
+  if (failures > 0) {
+    std::cerr << "quantile_sketch: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "quantile_sketch: all checks passed\n";
+
+  for (double& x : values) {
+    x = normal(rng);
+  }
+  double best = HUGE_VAL;
+  for (int run = 0; run < 3; run++) {
+    QuantileSketch sketch;
+    auto start = std::chrono::steady_clock::now();
+    sketch.add(values);
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, time.count());
+  }
+  std::printf("%-20s %.1f ns per value\n", "add()", best / kValues * 1e9);
+  return 0;
+}
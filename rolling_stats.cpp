@@ -0,0 +1,57 @@
+#include "rolling_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "running_stats.h"
+
+RollingStats::RollingStats(size_t window)
+    : ring_(window), next_(0), count_(0), mean_(0.0), m2_(0.0) {}
+
+void RollingStats::add(double x) {
+  if (std::isnan(x)) {
+    return;
+  }
+  if (count_ < ring_.size()) {
+    // Still filling the window: plain Welford.
+    count_++;
+    double delta = x - mean_;
+    mean_ += delta / count_;
+    m2_ += delta * (x - mean_);
+  } else {
+    double y = ring_[next_];
+    double old_mean = mean_;
+    mean_ += (x - y) / count_;
+    m2_ += (x - y) * (x - mean_ + y - old_mean);
+  }
+  ring_[next_] = x;
+  next_++;
+  if (next_ == ring_.size()) {
+    next_ = 0;
+    // The window is full and we've just wrapped around; start over from the
+    // exact values. (The order doesn't matter for the mean and variance.)
+    RunningStats exact;
+    exact.add(ring_);
+    mean_ = exact.mean();
+    m2_ = exact.variance() * count_;
+  }
+}
+
+double RollingStats::mean() const {
+  if (count_ == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return mean_;
+}
+
+double RollingStats::variance() const {
+  if (count_ == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  // Between recomputes, rounding can leave M2 a hair below zero when the
+  // window's values are all (nearly) equal.
+  return std::max(m2_, 0.0) / count_;
+}
+
+double RollingStats::stdev() const { return std::sqrt(variance()); }
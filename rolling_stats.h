@@ -0,0 +1,52 @@
+#ifndef ROLLING_STATS_H
+#define ROLLING_STATS_H
+
+#include <cstddef>
+#include <vector>
+
+// Mean and variance of the last `window` values added, for --window.
+//
+// Recomputing them from scratch after every value would take O(window) time
+// per value. Instead we keep the last `window` values in a ring buffer (a
+// vector used in a circle, where the newest value overwrites the oldest) and
+// update the mean and M2 (see running_stats.h) as each value enters and the
+// oldest one leaves. With x coming in and y going out of a full window of N
+// values:
+//
+//     mean' = mean + (x - y) / N
+//     M2'   = M2 + (x - y) * (x - mean' + y - mean)
+//
+// That's O(1) per value, like Welford's algorithm, which it's derived from.
+// But unlike Welford's algorithm, values leave as well as enter, and the
+// rounding errors of all those updates never leave: after millions of values
+// they add up, and M2 can even go slightly negative. So every time the ring
+// buffer wraps around, we recompute the mean and M2 exactly from the window's
+// values, with RunningStats. That's O(N) work once every N values, which is
+// still O(1) per value, and it keeps the error from growing.
+class RollingStats {
+ public:
+  // Requires window > 0.
+  explicit RollingStats(size_t window);
+
+  // NaN values are ignored.
+  void add(double x);
+
+  // Number of values in the window: the number added so far, up to window.
+  size_t count() const { return count_; }
+  // NaN if there's no data.
+  double mean() const;
+  // The population variance, like RunningStats::variance().
+  double variance() const;
+  double stdev() const;
+
+ private:
+  std::vector<double> ring_;
+  // Where the next value goes. Once the window is full, that's the oldest
+  // value.
+  size_t next_;
+  size_t count_;
+  double mean_;
+  double m2_;
+};
+
+#endif  // ROLLING_STATS_H
@@ -0,0 +1,153 @@
+// Checks RollingStats against computing the mean and variance of the last N
+// values from scratch, after every value added. Run it with `make check`.
+//
+// The O(1) updates in rolling_stats.h pick up rounding error that never
+// leaves; only the exact recompute each time the ring buffer wraps around
+// keeps it from growing. So the series are long enough to wrap many times,
+// and include values far from zero, like 1e9 plus small noise, where the
+// error is largest next to the variance. Windows range from 1 value to more
+// than the whole series, which never wraps at all.
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "rolling_stats.h"
+
+namespace {
+
+constexpr double kEpsilon = std::numeric_limits<double>::epsilon();
+
+int failures = 0;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+// The mean and population variance of the last n of values, in two passes,
+// in long double.
+void exact_stats(const std::deque<double>& values, size_t n, double* mean,
+                 double* variance) {
+  n = std::min(n, values.size());
+  long double sum = 0;
+  for (size_t i = values.size() - n; i < values.size(); i++) {
+    sum += values[i];
+  }
+  long double m = sum / n;
+  long double squares = 0;
+  for (size_t i = values.size() - n; i < values.size(); i++) {
+    squares += (values[i] - m) * (values[i] - m);
+  }
+  *mean = m;
+  *variance = squares / n;
+}
+
+// |x - exact| in units of unit, which may be 0 if x must be exact.
+double error(double x, double exact, double unit) {
+  return x == exact ? 0.0 : std::abs(x - exact) / unit;
+}
+
+// Adds the first n values of series to a RollingStats with the given window,
+// and compares it with the exact statistics of the last `window` values after
+// every value.
+void check(const std::string& what, const std::vector<double>& series,
+           size_t n, size_t window) {
+  std::string name = what + " with a window of " + std::to_string(window);
+  RollingStats stats(window);
+  // The last 2 * window values: every value that entered or left the window
+  // since the last recompute.
+  std::deque<double> recent;
+  // The worst errors, in units of the spread (standard deviation) of the
+  // recent values. The updates since the last recompute can leave an error
+  // in proportion to it, even when the window itself has no spread left, as
+  // when a window of 1, 2, 3 becomes 3, 3, 3. A double only holds a value to
+  // within about 1e-16 of itself, so the spread counts as at least 64 times
+  // that.
+  double worst_mean = 0;
+  double worst_variance = 0;
+  for (size_t i = 0; i < n; i++) {
+    stats.add(series[i]);
+    recent.push_back(series[i]);
+    if (recent.size() > 2 * window) {
+      recent.pop_front();
+    }
+    double mean, variance, recent_mean, recent_variance;
+    exact_stats(recent, window, &mean, &variance);
+    exact_stats(recent, 2 * window, &recent_mean, &recent_variance);
+    if (stats.count() != std::min(i + 1, window)) {
+      fail(name + ": count() is " + std::to_string(stats.count()) +
+           " after " + std::to_string(i + 1) + " values");
+      return;
+    }
+    double spread =
+        std::sqrt(recent_variance) + 64 * kEpsilon * std::abs(recent_mean);
+    worst_mean = std::max(worst_mean, error(stats.mean(), mean, spread));
+    worst_variance = std::max(
+        worst_variance, error(stats.variance(), variance, spread * spread));
+  }
+  // Without the recompute, the errors for 1e9 plus noise soon pass these.
+  if (!(worst_mean <= 2e-5) || !(worst_variance <= 5e-5)) {
+    fail(name + ": off by " + std::to_string(worst_mean) +
+         " standard deviations in the mean and " +
+         std::to_string(worst_variance) + " of the variance");
+  }
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  const size_t kValues = 1000000;
+
+  std::vector<double> centered(kValues);
+  std::vector<double> offset(kValues);
+  std::vector<double> drifting(kValues);
+  std::vector<double> steps(kValues);
+  for (size_t i = 0; i < kValues; i++) {
+    centered[i] = normal(rng);
+    offset[i] = 1e9 + normal(rng);
+    // A slow trend, so old and new values differ by more than the noise.
+    drifting[i] = 1e6 + i * 0.5 + normal(rng) * 1e-3;
+    // Runs of equal values.
+    steps[i] = double(i / 1000 % 3);
+  }
+  for (size_t window : {1, 2, 3, 10, 100, 1000, 4999, 5000, 1000000}) {
+    // Many laps of the ring buffer for small windows, and a window bigger
+    // than the input, which never wraps, for the biggest; the reference
+    // takes O(window) time per value.
+    size_t n = std::clamp<size_t>(2000000 / window, 5000, kValues);
+    check("values around 0", centered, n, window);
+    check("1e9 plus noise", offset, n, window);
+    check("drifting values", drifting, n, window);
+    check("runs of equal values", steps, n, window);
+  }
+
+  // NaN is ignored: it neither fills a slot nor pushes a value out.
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  RollingStats stats(2);
+  for (double x : {1.0, nan, 3.0, nan, nan}) {
+    stats.add(x);
+  }
+  if (stats.count() != 2 || stats.mean() != 2.0 || stats.variance() != 1.0) {
+    fail("NaN isn't ignored");
+  }
+  if (!std::isnan(RollingStats(5).mean()) ||
+      !std::isnan(RollingStats(5).variance())) {
+    fail("the statistics of no values aren't NaN");
+  }
+
+  if (failures > 0) {
+    std::cerr << "rolling_stats: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "rolling_stats: all checks passed\n";
+  return 0;
+}
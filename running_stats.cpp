@@ -0,0 +1,126 @@
+#include "running_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "sum_kernel.h"
+
+namespace {
+
+// How many values add(span) handles at a time. 8 KB of doubles easily fits in
+// the L1 cache, so the second loop over each block is nearly free.
+constexpr size_t kBlockSize = 1024;
+
+}  // namespace
+
+RunningStats::RunningStats()
+    : count_(0),
+      mean_(0.0),
+      m2_(0.0),
+      m3_(0.0),
+      m4_(0.0),
+      min_(std::numeric_limits<double>::infinity()),
+      max_(-std::numeric_limits<double>::infinity()) {}
+
+void RunningStats::add(double x) {
+  double n = ++count_;
+  double delta = x - mean_;
+  double delta_n = delta / n;
+  double delta_n2 = delta_n * delta_n;
+  double term = delta * delta_n * (n - 1);
+  mean_ += delta_n;
+  // The order matters: m4_ needs the old m3_ and m2_, and m3_ the old m2_.
+  m4_ += term * delta_n2 * (n * n - 3 * n + 3) + 6 * delta_n2 * m2_ -
+         4 * delta_n * m3_;
+  m3_ += term * delta_n * (n - 2) - 3 * delta_n * m2_;
+  m2_ += term;
+  min_ = x < min_ ? x : min_;
+  max_ = x > max_ ? x : max_;
+}
+
+// Calling add(x) for each value works, but the division in every step and the
+// dependency of each step on the one before make it slow. Instead, we compute
+// exact stats for one small block at a time, the simple two-pass way (sum,
+// then powers of the differences from the mean), and merge() each block in.
+// The block is still in the cache for the second loop, so main memory is only
+// read once. Both loops are SIMD kernels from sum_kernel.h.
+void RunningStats::add(std::span<const double> values) {
+  while (!values.empty()) {
+    std::span<const double> block =
+        values.first(std::min(values.size(), kBlockSize));
+    values = values.subspan(block.size());
+
+    double sum = compensated_sum(block);
+    RunningStats block_stats;
+    block_stats.count_ = block.size();
+    block_stats.mean_ = sum / block.size();
+    MomentSums sums = moment_sums(block, block_stats.mean_);
+    block_stats.m2_ = sums.m2;
+    block_stats.m3_ = sums.m3;
+    block_stats.m4_ = sums.m4;
+    block_stats.min_ = sums.min;
+    block_stats.max_ = sums.max;
+    merge(block_stats);
+  }
+}
+
+void RunningStats::merge(const RunningStats& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+  if (count_ == 0) {
+    *this = other;
+    return;
+  }
+  double n_a = count_;
+  double n_b = other.count_;
+  double n = n_a + n_b;
+  double delta = other.mean_ - mean_;
+  double delta2 = delta * delta;
+  mean_ += delta * (n_b / n);
+  // As in add(x), each line needs the old values of the moments below it.
+  m4_ += other.m4_ +
+         delta2 * delta2 * (n_a * n_b * (n_a * n_a - n_a * n_b + n_b * n_b)) /
+             (n * n * n) +
+         6 * delta2 * (n_a * n_a * other.m2_ + n_b * n_b * m2_) / (n * n) +
+         4 * delta * (n_a * other.m3_ - n_b * m3_) / n;
+  m3_ += other.m3_ + delta2 * delta * (n_a * n_b * (n_a - n_b)) / (n * n) +
+         3 * delta * (n_a * other.m2_ - n_b * m2_) / n;
+  m2_ += other.m2_ + delta2 * (n_a * n_b / n);
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+  count_ += other.count_;
+}
+
+double RunningStats::variance() const {
+  if (count_ == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  if (all_equal()) {
+    return 0.0;
+  }
+  return m2_ / count_;
+}
+
+double RunningStats::stdev() const { return std::sqrt(variance()); }
+
+double RunningStats::skewness() const {
+  if (count_ == 0 || all_equal()) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return std::sqrt(double(count_)) * m3_ / std::pow(m2_, 1.5);
+}
+
+double RunningStats::kurtosis() const {
+  if (count_ == 0 || all_equal()) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return count_ * m4_ / (m2_ * m2_) - 3.0;
+}
+
+// min() and max() skip NaN, but M2 doesn't: it's NaN if any value is NaN, and
+// also if the values are all the same infinity, since inf - inf is NaN.
+bool RunningStats::all_equal() const {
+  return min_ == max_ && !std::isnan(m2_);
+}
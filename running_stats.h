@@ -0,0 +1,76 @@
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+#include <cstddef>
+#include <span>
+
+// Computes count, mean, variance, minimum, maximum, skewness and kurtosis in a
+// single pass over the data, without storing it.
+//
+// The textbook formula, var = (sum of x^2)/N - mean^2, also takes one pass, but
+// it subtracts two huge, nearly equal numbers and can lose all its precision
+// (it can even return a negative variance). Instead we keep the mean and M2,
+// the sum of squared differences from the mean, and update them as values
+// arrive. This is Welford's algorithm:
+//
+//     https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
+//
+// Two RunningStats built from different parts of the data can be combined with
+// merge(), using the formula of Chan et al. from the same page. That lets us
+// split the work into pieces (batches, or threads) and combine the results.
+//
+// Skewness and kurtosis work the same way, with M3 and M4, the sums of cubed
+// and fourth-power differences from the mean. The update and merge formulas
+// for those are from Philippe Pébay, "Formulas for Robust, One-Pass Parallel
+// Computation of Covariances and Arbitrary-Order Statistical Moments" (Sandia
+// report SAND2008-6212), also summarized on the Wikipedia page.
+class RunningStats {
+ public:
+  RunningStats();
+
+  // Add one value.
+  void add(double x);
+
+  // Add a batch of values. This gives the same result as calling add() on each
+  // value (up to rounding), but faster. See running_stats.cpp.
+  void add(std::span<const double> values);
+
+  // Combine with stats computed from other data. Afterwards, *this describes
+  // both sets of data together.
+  void merge(const RunningStats& other);
+
+  size_t count() const { return count_; }
+  double mean() const { return mean_; }
+  // The population variance, M2 / N, like main() has always reported. NaN if
+  // there's no data, and exactly 0 if all the values are equal.
+  double variance() const;
+  double stdev() const;
+  // NaN values are ignored by min() and max() (but not by the others). With
+  // no data, min() is +infinity and max() is -infinity.
+  double min() const { return min_; }
+  double max() const { return max_; }
+  // The population skewness, sqrt(N) * M3 / M2^1.5: 0 for symmetric data,
+  // positive when the right tail is longer.
+  double skewness() const;
+  // The population excess kurtosis, N * M4 / M2^2 - 3: 0 for normally
+  // distributed data, positive for heavier tails.
+  double kurtosis() const;
+  // Both are NaN if there's no data, and also if all the values are equal:
+  // a distribution with no spread has no shape to describe (it's 0 / 0).
+
+ private:
+  size_t count_;
+  double mean_;
+  double m2_;
+  double m3_;
+  double m4_;
+  double min_;
+  double max_;
+
+  // Whether all the values are equal (and finite). M2 may not say so
+  // exactly: merge() combines means that can differ in the last bit, and
+  // leaves a tiny M2 made of rounding errors.
+  bool all_equal() const;
+};
+
+#endif  // RUNNING_STATS_H
@@ -0,0 +1,176 @@
+#include "sum_kernel.h"
+
+#include "sum_kernel_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define SUM_KERNEL_X86 1
+#endif
+
+double compensated_sum_scalar(const double* values, size_t n) {
+  double sums[kSumLanes] = {};
+  double comps[kSumLanes] = {};
+  size_t i = 0;
+  for (; i + kSumLanes <= n; i += kSumLanes) {
+    for (size_t lane = 0; lane < kSumLanes; lane++) {
+      neumaier_add(values[i + lane], &sums[lane], &comps[lane]);
+    }
+  }
+  return finish_sum(sums, comps, values + i, n - i);
+}
+
+MomentSums moment_sums_scalar(const double* values, size_t n, double mean) {
+  MomentSums lanes[kSumLanes];
+  init_moments(lanes);
+  size_t i = 0;
+  for (; i + kSumLanes <= n; i += kSumLanes) {
+    for (size_t lane = 0; lane < kSumLanes; lane++) {
+      moment_add(values[i + lane], mean, &lanes[lane]);
+    }
+  }
+  return finish_moments(lanes, mean, values + i, n - i);
+}
+
+#ifdef SUM_KERNEL_X86
+namespace {
+
+// The branch in neumaier_add(), done without branching for two lanes at once:
+// compute both candidate corrections and pick one per lane with a mask.
+inline void neumaier_add_sse2(__m128d x, __m128d* sum, __m128d* comp) {
+  // Clearing the sign bit gives the absolute value.
+  const __m128d abs_mask =
+      _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffff));
+  __m128d t = _mm_add_pd(*sum, x);
+  __m128d sum_bigger =
+      _mm_cmpge_pd(_mm_and_pd(*sum, abs_mask), _mm_and_pd(x, abs_mask));
+  __m128d if_sum_bigger = _mm_add_pd(_mm_sub_pd(*sum, t), x);
+  __m128d if_x_bigger = _mm_add_pd(_mm_sub_pd(x, t), *sum);
+  // SSE2 has no blend instruction; (mask & a) | (~mask & b) does the same.
+  __m128d correction = _mm_or_pd(_mm_and_pd(sum_bigger, if_sum_bigger),
+                                 _mm_andnot_pd(sum_bigger, if_x_bigger));
+  *comp = _mm_add_pd(*comp, correction);
+  *sum = t;
+}
+
+}  // namespace
+
+// Eight lanes in four SSE2 registers of two doubles each.
+double compensated_sum_sse2(const double* values, size_t n) {
+  __m128d sums[4];
+  __m128d comps[4];
+  for (int r = 0; r < 4; r++) {
+    sums[r] = _mm_setzero_pd();
+    comps[r] = _mm_setzero_pd();
+  }
+  size_t i = 0;
+  for (; i + kSumLanes <= n; i += kSumLanes) {
+    for (int r = 0; r < 4; r++) {
+      neumaier_add_sse2(_mm_loadu_pd(values + i + 2 * r), &sums[r], &comps[r]);
+    }
+  }
+  double sum_lanes[kSumLanes];
+  double comp_lanes[kSumLanes];
+  for (int r = 0; r < 4; r++) {
+    _mm_storeu_pd(sum_lanes + 2 * r, sums[r]);
+    _mm_storeu_pd(comp_lanes + 2 * r, comps[r]);
+  }
+  return finish_sum(sum_lanes, comp_lanes, values + i, n - i);
+}
+
+namespace {
+
+// moment_add() for two lanes at once.
+inline void moment_add_sse2(__m128d x, __m128d mean, __m128d* m2, __m128d* m3,
+                            __m128d* m4, __m128d* min, __m128d* max) {
+  __m128d diff = _mm_sub_pd(x, mean);
+  __m128d diff2 = _mm_mul_pd(diff, diff);
+  *m2 = _mm_add_pd(*m2, diff2);
+  *m3 = _mm_add_pd(*m3, _mm_mul_pd(diff2, diff));
+  *m4 = _mm_add_pd(*m4, _mm_mul_pd(diff2, diff2));
+  *min = _mm_min_pd(x, *min);
+  *max = _mm_max_pd(x, *max);
+}
+
+}  // namespace
+
+// Eight lanes in four SSE2 registers per sum, like compensated_sum_sse2().
+MomentSums moment_sums_sse2(const double* values, size_t n, double mean) {
+  const __m128d mean_v = _mm_set1_pd(mean);
+  __m128d m2[4], m3[4], m4[4], min[4], max[4];
+  for (int r = 0; r < 4; r++) {
+    m2[r] = m3[r] = m4[r] = _mm_setzero_pd();
+    min[r] = _mm_set1_pd(INFINITY);
+    max[r] = _mm_set1_pd(-INFINITY);
+  }
+  size_t i = 0;
+  for (; i + kSumLanes <= n; i += kSumLanes) {
+    for (int r = 0; r < 4; r++) {
+      moment_add_sse2(_mm_loadu_pd(values + i + 2 * r), mean_v, &m2[r],
+                      &m3[r], &m4[r], &min[r], &max[r]);
+    }
+  }
+  MomentSums lanes[kSumLanes];
+  for (int r = 0; r < 4; r++) {
+    double m2_lanes[2], m3_lanes[2], m4_lanes[2], min_lanes[2], max_lanes[2];
+    _mm_storeu_pd(m2_lanes, m2[r]);
+    _mm_storeu_pd(m3_lanes, m3[r]);
+    _mm_storeu_pd(m4_lanes, m4[r]);
+    _mm_storeu_pd(min_lanes, min[r]);
+    _mm_storeu_pd(max_lanes, max[r]);
+    for (int j = 0; j < 2; j++) {
+      lanes[2 * r + j] = MomentSums{m2_lanes[j], m3_lanes[j], m4_lanes[j],
+                                    min_lanes[j], max_lanes[j]};
+    }
+  }
+  return finish_moments(lanes, mean, values + i, n - i);
+}
+#endif  // SUM_KERNEL_X86
+
+namespace {
+
+using SumFn = double (*)(const double*, size_t);
+
+// Pick the fastest implementation this CPU supports, once at startup.
+SumFn choose_compensated_sum() {
+#ifdef SUM_KERNEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return compensated_sum_avx2;
+  }
+  return compensated_sum_sse2;
+#else
+  return compensated_sum_scalar;
+#endif
+}
+
+const SumFn compensated_sum_impl = choose_compensated_sum();
+
+}  // namespace
+
+double compensated_sum(std::span<const double> values) {
+  return compensated_sum_impl(values.data(), values.size());
+}
+
+namespace {
+
+using MomentsFn = MomentSums (*)(const double*, size_t, double);
+
+MomentsFn choose_moment_sums() {
+#ifdef SUM_KERNEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return moment_sums_avx2;
+  }
+  return moment_sums_sse2;
+#else
+  return moment_sums_scalar;
+#endif
+}
+
+const MomentsFn moment_sums_impl = choose_moment_sums();
+
+}  // namespace
+
+MomentSums moment_sums(std::span<const double> values, double mean) {
+  return moment_sums_impl(values.data(), values.size(), mean);
+}
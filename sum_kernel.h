@@ -0,0 +1,56 @@
+#ifndef SUM_KERNEL_H
+#define SUM_KERNEL_H
+
+#include <span>
+
+// Returns the sum of values, computed accurately and quickly.
+//
+// The obvious loop
+//
+//     double sum = 0.0;
+//     for (double x : values) sum += x;
+//
+// has two problems on large inputs:
+//
+// 1.  Precision. Each += rounds the result to 53 bits. Once the sum is much
+//     larger than the values being added, most of each value's bits are
+//     rounded away, and over 10^9 additions the errors add up.
+// 2.  Speed. Each += has to wait for the one before it to finish, and the
+//     compiler isn't allowed to reorder the additions (that would change the
+//     rounding), so it can't use SIMD instructions.
+//
+// We fix (1) with Neumaier's variant of Kahan summation: alongside the sum we
+// keep a compensation term that collects the low-order bits each addition
+// rounds off, and add it back at the end. See:
+//
+//     https://en.wikipedia.org/wiki/Kahan_summation_algorithm
+//
+// We fix (2) by explicitly keeping several independent sums ("lanes"), each
+// with its own compensation, and adding every 8th value to the same lane. The
+// lanes map directly onto SIMD registers (AVX2 or SSE2, chosen at startup based
+// on the CPU, like skip_fields() in byte_scan.h), and because the lanes don't
+// depend on each other, the CPU can work on several additions at once.
+//
+// The result is the same on every CPU, because all implementations add the
+// same values to the same lanes in the same order.
+double compensated_sum(std::span<const double> values);
+
+// The sums of (x - mean)^2, (x - mean)^3 and (x - mean)^4 over values, for
+// RunningStats::add(), along with the smallest and largest values. NaN values
+// are never picked as min or max; with no values, min is +infinity and max is
+// -infinity.
+//
+// These sums only run over a small block of values, close to their mean, so
+// we skip the compensation. The lanes are the same as in compensated_sum(),
+// and so is the reason for them, and the results are again the same on every
+// CPU.
+struct MomentSums {
+  double m2;
+  double m3;
+  double m4;
+  double min;
+  double max;
+};
+MomentSums moment_sums(std::span<const double> values, double mean);
+
+#endif  // SUM_KERNEL_H
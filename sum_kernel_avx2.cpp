@@ -0,0 +1,96 @@
+// AVX2 versions of compensated_sum() and moment_sums(). Compiled with -mavx2;
+// see the comment at the top of byte_scan_avx2.cpp for why it's a separate
+// file.
+
+#include "sum_kernel_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+namespace {
+
+// Same as neumaier_add_sse2() in sum_kernel.cpp, four lanes at a time. AVX has
+// a real blend instruction, so choosing the correction is one step.
+inline void neumaier_add_avx2(__m256d x, __m256d* sum, __m256d* comp) {
+  const __m256d abs_mask =
+      _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffff));
+  __m256d t = _mm256_add_pd(*sum, x);
+  __m256d sum_bigger = _mm256_cmp_pd(_mm256_and_pd(*sum, abs_mask),
+                                     _mm256_and_pd(x, abs_mask), _CMP_GE_OQ);
+  __m256d if_sum_bigger = _mm256_add_pd(_mm256_sub_pd(*sum, t), x);
+  __m256d if_x_bigger = _mm256_add_pd(_mm256_sub_pd(x, t), *sum);
+  *comp = _mm256_add_pd(
+      *comp, _mm256_blendv_pd(if_x_bigger, if_sum_bigger, sum_bigger));
+  *sum = t;
+}
+
+}  // namespace
+
+// Eight lanes in two AVX registers of four doubles each.
+double compensated_sum_avx2(const double* values, size_t n) {
+  __m256d sum0 = _mm256_setzero_pd();
+  __m256d sum1 = _mm256_setzero_pd();
+  __m256d comp0 = _mm256_setzero_pd();
+  __m256d comp1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + kSumLanes <= n; i += kSumLanes) {
+    neumaier_add_avx2(_mm256_loadu_pd(values + i), &sum0, &comp0);
+    neumaier_add_avx2(_mm256_loadu_pd(values + i + 4), &sum1, &comp1);
+  }
+  double sum_lanes[kSumLanes];
+  double comp_lanes[kSumLanes];
+  _mm256_storeu_pd(sum_lanes, sum0);
+  _mm256_storeu_pd(sum_lanes + 4, sum1);
+  _mm256_storeu_pd(comp_lanes, comp0);
+  _mm256_storeu_pd(comp_lanes + 4, comp1);
+  return finish_sum(sum_lanes, comp_lanes, values + i, n - i);
+}
+
+namespace {
+
+// moment_add() for four lanes at once.
+inline void moment_add_avx2(__m256d x, __m256d mean, __m256d* m2, __m256d* m3,
+                            __m256d* m4, __m256d* min, __m256d* max) {
+  __m256d diff = _mm256_sub_pd(x, mean);
+  __m256d diff2 = _mm256_mul_pd(diff, diff);
+  *m2 = _mm256_add_pd(*m2, diff2);
+  *m3 = _mm256_add_pd(*m3, _mm256_mul_pd(diff2, diff));
+  *m4 = _mm256_add_pd(*m4, _mm256_mul_pd(diff2, diff2));
+  *min = _mm256_min_pd(x, *min);
+  *max = _mm256_max_pd(x, *max);
+}
+
+}  // namespace
+
+// Eight lanes in two AVX registers per sum.
+MomentSums moment_sums_avx2(const double* values, size_t n, double mean) {
+  const __m256d mean_v = _mm256_set1_pd(mean);
+  __m256d m2[2], m3[2], m4[2], min[2], max[2];
+  for (int r = 0; r < 2; r++) {
+    m2[r] = m3[r] = m4[r] = _mm256_setzero_pd();
+    min[r] = _mm256_set1_pd(INFINITY);
+    max[r] = _mm256_set1_pd(-INFINITY);
+  }
+  size_t i = 0;
+  for (; i + kSumLanes <= n; i += kSumLanes) {
+    for (int r = 0; r < 2; r++) {
+      moment_add_avx2(_mm256_loadu_pd(values + i + 4 * r), mean_v, &m2[r],
+                      &m3[r], &m4[r], &min[r], &max[r]);
+    }
+  }
+  MomentSums lanes[kSumLanes];
+  for (int r = 0; r < 2; r++) {
+    double m2_lanes[4], m3_lanes[4], m4_lanes[4], min_lanes[4], max_lanes[4];
+    _mm256_storeu_pd(m2_lanes, m2[r]);
+    _mm256_storeu_pd(m3_lanes, m3[r]);
+    _mm256_storeu_pd(m4_lanes, m4[r]);
+    _mm256_storeu_pd(min_lanes, min[r]);
+    _mm256_storeu_pd(max_lanes, max[r]);
+    for (int j = 0; j < 4; j++) {
+      lanes[4 * r + j] = MomentSums{m2_lanes[j], m3_lanes[j], m4_lanes[j],
+                                    min_lanes[j], max_lanes[j]};
+    }
+  }
+  return finish_moments(lanes, mean, values + i, n - i);
+}
+#endif
@@ -0,0 +1,93 @@
+#ifndef SUM_KERNEL_INTERNAL_H
+#define SUM_KERNEL_INTERNAL_H
+
+// Implementation details shared by sum_kernel.cpp and sum_kernel_avx2.cpp. Not
+// part of the public interface; use sum_kernel.h instead.
+
+#include <cmath>
+#include <cstddef>
+
+#include "sum_kernel.h"
+
+// Number of independent lanes. All implementations must use the same number so
+// that they give identical results.
+constexpr size_t kSumLanes = 8;
+
+// One step of Neumaier summation: adds x to *sum, and the rounding error of
+// that addition to *comp.
+inline void neumaier_add(double x, double* sum, double* comp) {
+  double t = *sum + x;
+  if (std::fabs(*sum) >= std::fabs(x)) {
+    *comp += (*sum - t) + x;
+  } else {
+    *comp += (x - t) + *sum;
+  }
+  *sum = t;
+}
+
+// Combines per-lane sums and compensations, then adds the values left over
+// after the last full group of kSumLanes. Both are done with neumaier_add, in a
+// fixed order.
+inline double finish_sum(const double* sums, const double* comps,
+                         const double* tail, size_t tail_size) {
+  double sum = 0.0;
+  double comp = 0.0;
+  for (size_t i = 0; i < kSumLanes; i++) {
+    neumaier_add(sums[i], &sum, &comp);
+  }
+  for (size_t i = 0; i < kSumLanes; i++) {
+    neumaier_add(comps[i], &sum, &comp);
+  }
+  for (size_t i = 0; i < tail_size; i++) {
+    neumaier_add(tail[i], &sum, &comp);
+  }
+  return sum + comp;
+}
+
+double compensated_sum_scalar(const double* values, size_t n);
+double compensated_sum_sse2(const double* values, size_t n);
+double compensated_sum_avx2(const double* values, size_t n);
+
+// One value's contribution to moment_sums(), in one lane. x < *min ? x : *min
+// is exactly what the SSE2 and AVX min instructions compute (and likewise for
+// max), which is what keeps all the implementations identical.
+inline void moment_add(double x, double mean, MomentSums* lane) {
+  double diff = x - mean;
+  double diff2 = diff * diff;
+  lane->m2 += diff2;
+  lane->m3 += diff2 * diff;
+  lane->m4 += diff2 * diff2;
+  lane->min = x < lane->min ? x : lane->min;
+  lane->max = x > lane->max ? x : lane->max;
+}
+
+// Combines the per-lane results of moment_sums() in a fixed order, then adds
+// the values left over after the last full group of kSumLanes.
+inline MomentSums finish_moments(const MomentSums* lanes, double mean,
+                                 const double* tail, size_t tail_size) {
+  MomentSums result = lanes[0];
+  for (size_t i = 1; i < kSumLanes; i++) {
+    result.m2 += lanes[i].m2;
+    result.m3 += lanes[i].m3;
+    result.m4 += lanes[i].m4;
+    result.min = lanes[i].min < result.min ? lanes[i].min : result.min;
+    result.max = lanes[i].max > result.max ? lanes[i].max : result.max;
+  }
+  for (size_t i = 0; i < tail_size; i++) {
+    moment_add(tail[i], mean, &result);
+  }
+  return result;
+}
+
+// Lanes before any values are added.
+inline void init_moments(MomentSums* lanes) {
+  for (size_t i = 0; i < kSumLanes; i++) {
+    lanes[i] = MomentSums{0.0, 0.0, 0.0, INFINITY, -INFINITY};
+  }
+}
+
+MomentSums moment_sums_scalar(const double* values, size_t n, double mean);
+MomentSums moment_sums_sse2(const double* values, size_t n, double mean);
+MomentSums moment_sums_avx2(const double* values, size_t n, double mean);
+
+#endif  // SUM_KERNEL_INTERNAL_H
@@ -0,0 +1,207 @@
+// Checks compensated_sum() and moment_sums() against a long double
+// reference and against each other, and times them next to the naive loop.
+// Run it with `make check`.
+//
+// Each implementation (scalar, SSE2 and, if the CPU has it, AVX2) is called
+// directly, so the test covers the ones the dispatch in sum_kernel.cpp
+// doesn't pick on this machine. They must all give bit-identical results, as
+// sum_kernel.h promises.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "sum_kernel.h"
+#include "sum_kernel_internal.h"
+
+namespace {
+
+int failures = 0;
+
+// throughput() stores results here, so the compiler can't skip the work.
+volatile double sink;
+
+void fail(const std::string& message) {
+  if (++failures <= 10) {
+    std::cerr << message << '\n';
+  }
+}
+
+struct SumImpl {
+  const char* name;
+  double (*sum)(const double*, size_t);
+  MomentSums (*moments)(const double*, size_t, double);
+};
+
+std::vector<SumImpl> implementations() {
+  std::vector<SumImpl> impls = {
+      {"scalar", compensated_sum_scalar, moment_sums_scalar}};
+#if defined(__x86_64__) || defined(__i386__)
+  impls.push_back({"SSE2", compensated_sum_sse2, moment_sums_sse2});
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    impls.push_back({"AVX2", compensated_sum_avx2, moment_sums_avx2});
+  }
+#endif
+  return impls;
+}
+
+double naive_sum(const double* values, size_t n) {
+  double sum = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    sum += values[i];
+  }
+  return sum;
+}
+
+// The exact answers, or close enough: long double has 11 more bits than
+// double on x86 (and is the same as double on some other CPUs, where the
+// error checks below are looser than they look).
+long double reference_sum(const std::vector<double>& values) {
+  long double sum = 0.0L;
+  for (double x : values) {
+    sum += x;
+  }
+  return sum;
+}
+
+bool same_bits(double a, double b) {
+  return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+bool same_moments(const MomentSums& a, const MomentSums& b) {
+  return same_bits(a.m2, b.m2) && same_bits(a.m3, b.m3) &&
+         same_bits(a.m4, b.m4) && same_bits(a.min, b.min) &&
+         same_bits(a.max, b.max);
+}
+
+// Returns values per second for f(values.data(), values.size()), which
+// returns a double, the fastest of a few runs.
+template <typename F>
+double throughput(const std::vector<double>& values, const F& f) {
+  double best = HUGE_VAL;
+  for (int run = 0; run < 5; run++) {
+    auto start = std::chrono::steady_clock::now();
+    sink = f(values.data(), values.size());
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, time.count());
+  }
+  return values.size() / best;
+}
+
+}  // namespace
+
+int main() {
+  std::vector<SumImpl> impls = implementations();
+  std::mt19937_64 rng(42);
+
+  // The implementations agree, for every tail length and with NaN in a lane.
+  std::normal_distribution<double> normal(0.0, 1.0);
+  for (size_t n : {0, 1, 7, 8, 9, 15, 16, 17, 1000, 100003}) {
+    std::vector<double> values(n);
+    for (double& x : values) {
+      x = normal(rng);
+    }
+    if (n > 10) {
+      values[n / 2] = NAN;
+    }
+    // All of values, and the first half, which has no NaN.
+    for (size_t size : {n, n / 2}) {
+      std::span<const double> v(values.data(), size);
+      double sum = impls[0].sum(v.data(), v.size());
+      MomentSums moments = impls[0].moments(v.data(), v.size(), 0.5);
+      for (const SumImpl& impl : impls) {
+        if (!same_bits(impl.sum(v.data(), v.size()), sum)) {
+          fail(std::string(impl.name) + " compensated_sum() differs from "
+               "scalar for n = " + std::to_string(v.size()));
+        }
+        if (!same_moments(impl.moments(v.data(), v.size(), 0.5), moments)) {
+          fail(std::string(impl.name) + " moment_sums() differs from "
+               "scalar for n = " + std::to_string(v.size()));
+        }
+      }
+    }
+  }
+
+  // Cancellation that the naive loop gets completely wrong: it returns 0.
+  std::vector<double> cancel = {1.0, 1e100, 1.0, -1e100};
+  for (const SumImpl& impl : impls) {
+    // Once as a tail, shorter than a group of lanes, and once all in the
+    // same lane.
+    std::vector<double> one_lane(4 * kSumLanes, 0.0);
+    for (size_t i = 0; i < 4; i++) {
+      one_lane[i * kSumLanes] = cancel[i];
+    }
+    if (impl.sum(cancel.data(), cancel.size()) != 2.0 ||
+        impl.sum(one_lane.data(), one_lane.size()) != 2.0) {
+      fail(std::string(impl.name) + " compensated_sum() loses the 1s in "
+           "{1, 1e100, 1, -1e100}");
+    }
+  }
+
+  // Accuracy on a large input whose sum is much bigger than its spread: 2^24
+  // values from N(1e6, 1), as in a long measurement of a roughly constant
+  // quantity.
+  std::normal_distribution<double> offset(1e6, 1.0);
+  std::vector<double> values(1 << 24);
+  for (double& x : values) {
+    x = offset(rng);
+  }
+  long double exact = reference_sum(values);
+  double naive = naive_sum(values.data(), values.size());
+  double naive_error = std::fabs((naive - exact) / exact);
+  std::printf("%-8s %6.2f Gvalues/s, relative error %.1e\n", "naive",
+              throughput(values, naive_sum) / 1e9, naive_error);
+  for (const SumImpl& impl : impls) {
+    double sum = impl.sum(values.data(), values.size());
+    double error = std::fabs((sum - exact) / exact);
+    std::printf("%-8s %6.2f Gvalues/s, relative error %.1e\n", impl.name,
+                throughput(values, impl.sum) / 1e9, error);
+    // Neumaier summation is within a couple of roundings of the exact sum.
+    if (error > 2e-16 || error > naive_error) {
+      fail(std::string(impl.name) + " compensated_sum() is inaccurate");
+    }
+  }
+
+  // moment_sums() against long double, on values near their mean, as
+  // RunningStats::add() calls it.
+  double mean = 1e6;
+  long double m2 = 0.0L;
+  long double m4 = 0.0L;
+  for (double x : values) {
+    long double diff = x - static_cast<long double>(mean);
+    m2 += diff * diff;
+    m4 += diff * diff * diff * diff;
+  }
+  for (const SumImpl& impl : impls) {
+    MomentSums moments = impl.moments(values.data(), values.size(), mean);
+    double m2_error = std::fabs((moments.m2 - m2) / m2);
+    double m4_error = std::fabs((moments.m4 - m4) / m4);
+    std::printf("%-8s %6.2f Gvalues/s for moment_sums(), relative error "
+                "%.1e (M2), %.1e (M4)\n",
+                impl.name,
+                throughput(values,
+                           [&](const double* v, size_t n) {
+                             return impl.moments(v, n, mean).m2;
+                           }) /
+                    1e9,
+                m2_error, m4_error);
+    if (m2_error > 1e-12 || m4_error > 1e-12) {
+      fail(std::string(impl.name) + " moment_sums() is inaccurate");
+    }
+  }
+
+  if (failures > 0) {
+    std::cerr << "sum_kernel: " << failures << " checks failed\n";
+    return 1;
+  }
+  std::cout << "sum_kernel: all checks passed\n";
+  return 0;
+}
@@ -0,0 +1,26 @@
+#include "summary.h"
+
+#include <utility>
+
+Summary::Summary(bool quantiles, Histogram histogram)
+    : histogram_(std::move(histogram)) {
+  if (quantiles) {
+    quantiles_.emplace();
+  }
+}
+
+void Summary::add(std::span<const double> values) {
+  stats_.add(values);
+  if (quantiles_) {
+    quantiles_->add(values);
+  }
+  histogram_.add(values);
+}
+
+void Summary::merge(const Summary& other) {
+  stats_.merge(other.stats_);
+  if (quantiles_ && other.quantiles_) {
+    quantiles_->merge(*other.quantiles_);
+  }
+  histogram_.merge(other.histogram_);
+}
@@ -0,0 +1,44 @@
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include <optional>
+#include <span>
+
+#include "histogram.h"
+#include "quantile_sketch.h"
+#include "running_stats.h"
+
+// Everything main() reports about a set of values: RunningStats for the count,
+// mean and variance, and optionally a QuantileSketch for the median and the
+// tails and a Histogram. All of them take one pass and can be merged, so a
+// Summary can too, which makes it an Accumulator for parallel_accumulate() and
+// pipelined_accumulate().
+//
+// The sketch is optional because it dominates the cost: RunningStats is a few
+// SIMD operations per value, while the sketch sorts every value (see
+// quantile_sketch.h). On 5 * 10^7 values from a --bin file, computing took
+// 0.09 seconds without the sketch and 1.7 seconds with it.
+class Summary {
+ public:
+  // quantiles says whether to keep a QuantileSketch. histogram says which
+  // buckets to count values in, if any. (It should be empty; its counts are
+  // added to.)
+  explicit Summary(bool quantiles = false, Histogram histogram = Histogram());
+
+  void add(std::span<const double> values);
+  void merge(const Summary& other);
+
+  const RunningStats& stats() const { return stats_; }
+  // nullptr if the Summary was made without quantiles.
+  const QuantileSketch* quantiles() const {
+    return quantiles_ ? &*quantiles_ : nullptr;
+  }
+  const Histogram& histogram() const { return histogram_; }
+
+ private:
+  RunningStats stats_;
+  std::optional<QuantileSketch> quantiles_;
+  Histogram histogram_;
+};
+
+#endif  // SUMMARY_H